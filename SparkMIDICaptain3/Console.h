@@ -0,0 +1,33 @@
+#ifndef Console_h
+#define Console_h
+
+// Simple command line on the USB serial port
+//
+//   lat          show the MIDI to amp latency histograms
+//   lat reset    clear the latency histograms
+//   trace        dump the event trace ring (see tools/trace_timeline.py)
+//   trace clear  empty the event trace ring
+//   log          show the deferred logging counters
+//   midi         show the MIDI event queue counters
+//   clock        show the tempo from MIDI clock and what was sent to the amp
+//   merge        show the merge priorities and how many events were dropped as duplicates
+//   merge <ms>   set the duplicate window
+//   param        show how often coalesced parameter changes are sent
+//   param <ms>   set it (0 sends every change at once)
+//   map          show the mapping profile in use
+//   map <n>      switch to mapping profile n (0 is built in, others are /map<n>.txt on LittleFS)
+//   setlist      show where the setlist is, what the amp's temporary slot has in it, and switch times
+//   presets      bytes on air for every pair of presets in SparkPresets.h, whole preset against a diff
+//   custom <n>   switch to preset n from SparkPresets.h, and show what it cost
+//   ble          show how the Spark and pedal were connected and how long it took
+//   ble forget   clear the saved Spark and pedal so the next boot scans for them
+//   cpu          show how much of the time loop() was idle since the last 'cpu'
+
+#define CONSOLE_LINE_MAX 40
+
+char console_line[CONSOLE_LINE_MAX + 1];
+int console_pos = 0;
+
+void update_console();
+
+#endif
@@ -0,0 +1,95 @@
+#include "Console.h"
+
+void console_custom_preset(int n) {
+  SparkPreset p;
+
+  if (n < 0 || n >= sizeof(my_presets) / sizeof(SparkPreset *)) return;
+  p = *my_presets[n];
+  change_custom_preset(&p, TMP_PRESET);   // never over a preset stored on the amp
+  Serial.print(custom_switch_diff ? "Diff " : "Whole preset ");
+  Serial.print(custom_switch_bytes);
+  Serial.print(" bytes ");
+  Serial.print(custom_switch_us);
+  Serial.println(custom_switch_acked ? " us to the ack" : " us, no ack");
+}
+
+void console_param_report() {
+  Serial.print("Parameter changes sent at most every ");
+  Serial.print(param_flush_interval);
+  Serial.println(" ms");
+}
+
+void console_command(char *cmd) {
+  if (strcmp(cmd, "lat") == 0) 
+    latency_report();
+  else if (strcmp(cmd, "lat reset") == 0) {
+    latency_reset();
+    Serial.println("Latency histograms reset");
+  }
+  else if (strcmp(cmd, "cpu") == 0) 
+    loop_stats_report();
+  else if (strcmp(cmd, "log") == 0) 
+    dlog.report();
+  else if (strcmp(cmd, "midi") == 0) 
+    midi_report();
+  else if (strcmp(cmd, "clock") == 0) 
+    midi_clock_report();
+  else if (strcmp(cmd, "merge") == 0) 
+    midi_merge_report();
+  else if (strncmp(cmd, "merge ", 6) == 0) {
+    merge_window_us = atoi(&cmd[6]) * 1000UL;
+    midi_merge_report();
+  }
+  else if (strcmp(cmd, "param") == 0) 
+    console_param_report();
+  else if (strncmp(cmd, "param ", 6) == 0) {
+    param_flush_interval = atoi(&cmd[6]);
+    console_param_report();
+  }
+  else if (strcmp(cmd, "map") == 0) 
+    midi_map_report();
+  else if (strncmp(cmd, "map ", 4) == 0) {
+    if (!midi_map_select(atoi(&cmd[4]))) Serial.println("Mapping profile not loaded");
+    midi_map_report();
+  }
+  else if (strcmp(cmd, "setlist") == 0) 
+    setlist_report();
+  else if (strcmp(cmd, "presets") == 0) 
+    preset_diff_report();
+  else if (strncmp(cmd, "custom ", 7) == 0) 
+    console_custom_preset(atoi(&cmd[7]));
+  else if (strcmp(cmd, "ble") == 0) 
+    ble_report();
+  else if (strcmp(cmd, "ble forget") == 0) {
+    forget_known_devices();
+    Serial.println("Saved Spark and pedal cleared - the next boot will scan");
+  }
+  else if (strcmp(cmd, "trace") == 0) 
+    trace_dump();
+  else if (strcmp(cmd, "trace clear") == 0) {
+    trace_clear();
+    Serial.println("Trace cleared");
+  }
+  else if (cmd[0] != '\0') {
+    Serial.print("Unknown command: ");
+    Serial.println(cmd);
+  }
+}
+
+// read whatever has arrived and run the command once a whole line is in
+void update_console() {
+  char c;
+
+  while (Serial.available()) {
+    c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      console_line[console_pos] = '\0';
+      dlog.hold();                       // the log task waits until the report is written
+      console_command(console_line);
+      dlog.release();
+      console_pos = 0;
+    }
+    else if (console_pos < CONSOLE_LINE_MAX) 
+      console_line[console_pos++] = c;
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef DeferredLog_h
+#define DeferredLog_h
+
+// Deferred logging for DEB() and DEBUG()
+//
+// Writing to Serial at 115200 baud takes around 90us a character, so a line printed from the MIDI path 
+// stalls loop() for milliseconds. Instead each print() / println() just copies its argument into a ring
+// and a low priority task does the formatting and the writing to Serial.
+// String literals are held as pointers, other strings are copied in pieces of LOG_TEXT_LEN - 1 characters.
+// If the ring is full the item is dropped and counted, and so is the rest of its line, so a line is never
+// written with a piece missing from the middle. If the start of the line was already in the ring it is ended
+// with " [dropped]" before the next line.
+// Anything else that writes to Serial from loop(), like the console reports, goes between hold() and
+// release(). hold() writes out what is already in the ring and keeps the task off Serial until release(),
+// so a report is never broken up by log lines.
+
+#include "esp_memory_utils.h"
+
+#define LOG_ITEMS     256
+#define LOG_TEXT_LEN  20
+
+enum log_kind_t {LOG_POINTER, LOG_TEXT, LOG_SIGNED, LOG_UNSIGNED, LOG_FLOAT};
+
+struct log_item {
+  uint8_t kind;
+  uint8_t base;                // base for integers, digits for floats
+  bool newline;
+  union {
+    const char *ptr;
+    long i;
+    unsigned long u;
+    double f;
+    char text[LOG_TEXT_LEN];
+  };
+};
+
+class DeferredLog
+{
+  public:
+    DeferredLog() {
+      head = 0;
+      tail = 0;
+      items_logged = 0;
+      items_dropped = 0;
+      lines_dropped = 0;
+      high_water = 0;
+      line_started = false;
+      dropping_line = false;
+      line_cut = false;
+      drain_task = NULL;
+      serial_lock = NULL;
+      mux = portMUX_INITIALIZER_UNLOCKED;
+    };
+    void begin();
+    void drain();
+    void hold();
+    void release();
+
+    void print(const char *s)                    { add_string(s, false); };
+    void print(char c)                           { char s[2] = {c, '\0'}; add_string(s, false); };
+    void print(unsigned char b, int base = DEC)  { add_unsigned(b, base, false); };
+    void print(int n, int base = DEC)            { add_signed(n, base, false); };
+    void print(unsigned int n, int base = DEC)   { add_unsigned(n, base, false); };
+    void print(long n, int base = DEC)           { add_signed(n, base, false); };
+    void print(unsigned long n, int base = DEC)  { add_unsigned(n, base, false); };
+    void print(double f, int digits = 2)         { add_float(f, digits, false); };
+
+    void println()                               { add_string("", true); };
+    void println(const char *s)                  { add_string(s, true); };
+    void println(char c)                         { char s[2] = {c, '\0'}; add_string(s, true); };
+    void println(unsigned char b, int base = DEC){ add_unsigned(b, base, true); };
+    void println(int n, int base = DEC)          { add_signed(n, base, true); };
+    void println(unsigned int n, int base = DEC) { add_unsigned(n, base, true); };
+    void println(long n, int base = DEC)         { add_signed(n, base, true); };
+    void println(unsigned long n, int base = DEC){ add_unsigned(n, base, true); };
+    void println(double f, int digits = 2)       { add_float(f, digits, true); };
+
+    void report();
+
+    unsigned long items_logged;
+    unsigned long items_dropped;
+    unsigned long lines_dropped;
+    int high_water;
+
+  private:
+    void add(log_item *item);
+    void write_items();
+    void add_string(const char *s, bool newline);
+    void add_signed(long n, int base, bool newline);
+    void add_unsigned(unsigned long n, int base, bool newline);
+    void add_float(double f, int digits, bool newline);
+
+    log_item ring[LOG_ITEMS];
+    int head, tail;
+    bool line_started;           // part of the line being logged is in the ring
+    bool dropping_line;          // an item of the line being logged was dropped, so the rest of it goes too
+    bool line_cut;               // a line was dropped after its start went in the ring, and needs ending
+    TaskHandle_t drain_task;
+    SemaphoreHandle_t serial_lock;
+    portMUX_TYPE mux;
+};
+
+DeferredLog dlog;
+
+#endif
@@ -0,0 +1,173 @@
+#include "DeferredLog.h"
+
+//
+// DeferredLog class
+//
+
+void log_drain_task(void *arg) {
+  DeferredLog *log = (DeferredLog *) arg;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+    log->drain();
+  }
+}
+
+// items logged before begin() are held and written once the task is running
+void DeferredLog::begin() {
+  serial_lock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(log_drain_task, "log_drain", 3072, this, tskIDLE_PRIORITY + 1, &drain_task, 0);
+}
+
+void DeferredLog::add(log_item *item) {
+  log_item cut;
+  int used;
+  bool added;
+
+  cut.kind = LOG_POINTER;
+  cut.newline = true;
+  cut.ptr = " [dropped]";
+
+  taskENTER_CRITICAL(&mux);
+  used = (head - tail + LOG_ITEMS) % LOG_ITEMS;
+  if (dropping_line) 
+    added = false;
+  else
+    added = (used + (line_cut ? 2 : 1) < LOG_ITEMS);    // a cut line is ended first
+  if (added) {
+    if (line_cut) {
+      ring[head] = cut;
+      head = (head + 1) % LOG_ITEMS;
+      line_cut = false;
+    }
+    ring[head] = *item;
+    head = (head + 1) % LOG_ITEMS;
+    items_logged++;
+    line_started = !item->newline;
+    used = (head - tail + LOG_ITEMS) % LOG_ITEMS;
+    if (used > high_water) high_water = used;
+  }
+  else {
+    items_dropped++;
+    if (line_started) line_cut = true;
+    line_started = false;
+    dropping_line = !item->newline;
+    if (item->newline) lines_dropped++;
+  }
+  taskEXIT_CRITICAL(&mux);
+
+  if (added && item->newline && drain_task != NULL) 
+    xTaskNotifyGive(drain_task);
+}
+
+void DeferredLog::add_string(const char *s, bool newline) {
+  log_item item;
+  int len;
+
+  item.newline = newline;
+  // literals live in flash and won't change, so only the pointer is needed
+  if (esp_ptr_in_drom(s)) {
+    item.kind = LOG_POINTER;
+    item.ptr = s;
+    add(&item);
+    return;
+  }
+
+  item.kind = LOG_TEXT;
+  len = strlen(s);
+  do {
+    strncpy(item.text, s, LOG_TEXT_LEN - 1);
+    item.text[LOG_TEXT_LEN - 1] = '\0';
+    s += strlen(item.text);
+    len -= strlen(item.text);
+    item.newline = newline && (len == 0);
+    add(&item);
+  } while (len > 0);
+}
+
+void DeferredLog::add_signed(long n, int base, bool newline) {
+  log_item item;
+
+  item.kind = LOG_SIGNED;
+  item.base = base;
+  item.newline = newline;
+  item.i = n;
+  add(&item);
+}
+
+void DeferredLog::add_unsigned(unsigned long n, int base, bool newline) {
+  log_item item;
+
+  item.kind = LOG_UNSIGNED;
+  item.base = base;
+  item.newline = newline;
+  item.u = n;
+  add(&item);
+}
+
+void DeferredLog::add_float(double f, int digits, bool newline) {
+  log_item item;
+
+  item.kind = LOG_FLOAT;
+  item.base = digits;
+  item.newline = newline;
+  item.f = f;
+  add(&item);
+}
+
+// called from the drain task
+void DeferredLog::drain() {
+  xSemaphoreTake(serial_lock, portMAX_DELAY);
+  write_items();
+  xSemaphoreGive(serial_lock);
+}
+
+// called from loop() before it writes to Serial itself
+void DeferredLog::hold() {
+  if (serial_lock != NULL) xSemaphoreTake(serial_lock, portMAX_DELAY);
+  write_items();
+}
+
+void DeferredLog::release() {
+  if (serial_lock != NULL) xSemaphoreGive(serial_lock);
+}
+
+// format and write everything in the ring - only with serial_lock held, or before begin()
+void DeferredLog::write_items() {
+  log_item item;
+  bool got;
+
+  do {
+    taskENTER_CRITICAL(&mux);
+    got = (tail != head);
+    if (got) {
+      item = ring[tail];
+      tail = (tail + 1) % LOG_ITEMS;
+    }
+    taskEXIT_CRITICAL(&mux);
+
+    if (got) {
+      switch (item.kind) {
+        case LOG_POINTER:  Serial.print(item.ptr);            break;
+        case LOG_TEXT:     Serial.print(item.text);           break;
+        case LOG_SIGNED:   Serial.print(item.i, item.base);   break;
+        case LOG_UNSIGNED: Serial.print(item.u, item.base);   break;
+        case LOG_FLOAT:    Serial.print(item.f, item.base);   break;
+      }
+      if (item.newline) Serial.println();
+    }
+  } while (got);
+}
+
+void DeferredLog::report() {
+  Serial.print("Log items logged: ");
+  Serial.print(items_logged);
+  Serial.print("  dropped: ");
+  Serial.print(items_dropped);
+  Serial.print("  lines dropped: ");
+  Serial.print(lines_dropped);
+  Serial.print("  high water: ");
+  Serial.print(high_water);
+  Serial.print(" of ");
+  Serial.println(LOG_ITEMS);
+}
@@ -0,0 +1,50 @@
+#ifndef Latency_h
+#define Latency_h
+
+// Latency histograms for MIDI input to amp output, one set per MIDI source
+//
+// Times are taken in micros() at byte arrival, when loop() dispatches the action and when the 
+// resulting message is written to the amp by batch_flush() or spark_send()
+// Blocks passed through from the app and background preset upload blocks don't carry a dispatched
+// change, so they don't end a measurement
+// Buckets are logarithmic - four per power of two - so percentiles are accurate to about 20%
+
+#define LAT_BUCKETS 96
+#define LAT_PENDING_MAX 8
+
+enum latency_stage_t {LAT_DISPATCH, LAT_SEND, LAT_STAGES};
+
+class LatencyHistogram
+{
+  public:
+    LatencyHistogram() { reset(); };
+    void reset();
+    void add(unsigned long us);
+    unsigned long percentile(int pct);
+
+    unsigned long count;
+    unsigned long max_us;
+    uint32_t buckets[LAT_BUCKETS];
+
+  private:
+    int bucket_for(unsigned long us);
+    unsigned long bucket_top(int bucket);
+};
+
+LatencyHistogram latency_hist[MIDI_SRC_COUNT][LAT_STAGES];
+
+struct latency_pending {
+  int source;
+  unsigned long arrival;
+};
+
+latency_pending lat_pending[LAT_PENDING_MAX];
+int lat_pending_count = 0;
+
+void latency_dispatch(int source, unsigned long arrival);
+void latency_sent();
+void latency_tick_end();
+void latency_reset();
+void latency_report();
+
+#endif
@@ -0,0 +1,107 @@
+#include "Latency.h"
+
+//
+// LatencyHistogram class
+//
+
+void LatencyHistogram::reset() {
+  count = 0;
+  max_us = 0;
+  memset(buckets, 0, sizeof(buckets));
+}
+
+// bucket 4n to 4n+3 hold values from 2^n up to 2^(n+1)
+int LatencyHistogram::bucket_for(unsigned long us) {
+  int msb, bucket;
+
+  if (us < 4) return us;
+  msb = 31 - __builtin_clz(us);
+  bucket = msb * 4 + ((us >> (msb - 2)) & 0x03);
+  if (bucket >= LAT_BUCKETS) bucket = LAT_BUCKETS - 1;
+  return bucket;
+}
+
+unsigned long LatencyHistogram::bucket_top(int bucket) {
+  int msb;
+
+  if (bucket < 4) return bucket;
+  msb = bucket / 4;
+  return (1UL << msb) + ((unsigned long) (bucket % 4 + 1) << (msb - 2)) - 1;
+}
+
+void LatencyHistogram::add(unsigned long us) {
+  buckets[bucket_for(us)]++;
+  count++;
+  if (us > max_us) max_us = us;
+}
+
+unsigned long LatencyHistogram::percentile(int pct) {
+  unsigned long target, total;
+  int i;
+
+  if (count == 0) return 0;
+  target = (count * pct + 99) / 100;
+  total = 0;
+  for (i = 0; i < LAT_BUCKETS; i++) {
+    total += buckets[i];
+    if (total >= target) break;
+  }
+  return min(bucket_top(i), max_us);
+}
+
+//
+// Recording
+//
+
+// called by loop() when it acts on a MIDI message - the latency to send is completed by latency_sent()
+void latency_dispatch(int source, unsigned long arrival) {
+  unsigned long now = micros();
+
+  latency_hist[source][LAT_DISPATCH].add(now - arrival);
+  if (lat_pending_count < LAT_PENDING_MAX) {
+    lat_pending[lat_pending_count].source = source;
+    lat_pending[lat_pending_count].arrival = arrival;
+    lat_pending_count++;
+  }
+}
+
+// called after a block of messages from loop() is written to the amp - see Latency.h
+void latency_sent() {
+  unsigned long now = micros();
+  int i;
+
+  for (i = 0; i < lat_pending_count; i++)
+    latency_hist[lat_pending[i].source][LAT_SEND].add(now - lat_pending[i].arrival);
+  lat_pending_count = 0;
+}
+
+// anything dispatched that didn't cause a message to the amp is not counted
+// unless it is a parameter change still waiting to be sent
+void latency_tick_end() {
+  if (param_changes_pending == 0)
+    lat_pending_count = 0;
+}
+
+void latency_reset() {
+  int src, stage;
+
+  for (src = 0; src < MIDI_SRC_COUNT; src++)
+    for (stage = 0; stage < LAT_STAGES; stage++)
+      latency_hist[src][stage].reset();
+  lat_pending_count = 0;
+}
+
+void latency_report() {
+  char buf[100];
+  int src, stage;
+  LatencyHistogram *h;
+
+  Serial.println("Latency (us)          stage        count      p50      p99      max");
+  for (src = 0; src < MIDI_SRC_COUNT; src++)
+    for (stage = 0; stage < LAT_STAGES; stage++) {
+      h = &latency_hist[src][stage];
+      sprintf(buf, "%-20s  %-10s %7lu %8lu %8lu %8lu", midi_source_names[src], stage == LAT_DISPATCH ? "dispatch" : "send",
+              h->count, h->percentile(50), h->percentile(99), h->max_us);
+      Serial.println(buf);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef LoopEvents_h
+#define LoopEvents_h
+
+// Event driven main loop
+//
+// Every producer of work for loop() - DIN MIDI, USB MIDI, the BLE pedal, and packets from the amp and the app -
+// sets a bit in loop_events. loop() blocks in wait_for_loop_events() until one is set or a timer is due,
+// instead of spinning round polling everything.
+// Undefine LOOP_EVENTS to go back to a spinning loop (useful to compare the idle figures from 'cpu').
+// That comparison hasn't been made on the hardware yet - see 'Main loop' in README.md.
+
+#define LOOP_EVENTS
+
+#define EV_MIDI_DIN     BIT0
+#define EV_MIDI_USB     BIT1
+#define EV_MIDI_BLE     BIT2
+#define EV_FROM_SPARK   BIT3
+#define EV_FROM_APP     BIT4
+#define EV_ALL          (EV_MIDI_DIN | EV_MIDI_USB | EV_MIDI_BLE | EV_FROM_SPARK | EV_FROM_APP)
+
+#define LOOP_MAX_WAIT   50        // ms - longest loop() will sleep, so timers and the console still get looked at
+
+EventGroupHandle_t loop_events = NULL;
+
+// measurement of how much of the time loop() spends waiting
+unsigned long loop_wait_us;
+unsigned long loop_count;
+// and how long each time round takes when it isn't waiting
+unsigned long loop_work_start;
+unsigned long loop_work_us;
+unsigned long loop_work_max_us;
+unsigned long loop_stats_start;
+
+void loop_events_start();
+void loop_signal(EventBits_t bits);
+EventBits_t wait_for_loop_events(unsigned long max_wait_ms);
+void loop_stats_report();
+
+#endif
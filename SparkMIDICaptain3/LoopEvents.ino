@@ -0,0 +1,59 @@
+#include "LoopEvents.h"
+
+void loop_events_start() {
+  loop_events = xEventGroupCreate();
+  loop_wait_us = 0;
+  loop_work_us = 0;
+  loop_work_max_us = 0;
+  loop_count = 0;
+  loop_stats_start = micros();
+}
+
+// called by the producers, from whichever task they run in
+void loop_signal(EventBits_t bits) {
+  if (loop_events != NULL) 
+    xEventGroupSetBits(loop_events, bits);
+}
+
+// block until there is something to do, or max_wait_ms has passed
+EventBits_t wait_for_loop_events(unsigned long max_wait_ms) {
+  EventBits_t bits;
+  unsigned long t;
+
+  t = micros();
+  if (loop_count > 0) {
+    // time spent working in the iteration that has just finished
+    loop_work_us += t - loop_work_start;
+    if (t - loop_work_start > loop_work_max_us) loop_work_max_us = t - loop_work_start;
+  }
+  loop_count++;
+#ifdef LOOP_EVENTS
+  bits = xEventGroupWaitBits(loop_events, EV_ALL, pdTRUE, pdFALSE, pdMS_TO_TICKS(max_wait_ms));
+  loop_wait_us += micros() - t;
+#else
+  bits = xEventGroupClearBits(loop_events, EV_ALL);
+#endif
+  loop_work_start = micros();
+  return bits;
+}
+
+// time loop() spent waiting for work since the last report
+void loop_stats_report() {
+  unsigned long elapsed;
+
+  elapsed = micros() - loop_stats_start;
+  Serial.print("loop() idle: ");
+  Serial.print(100.0 * loop_wait_us / elapsed, 1);
+  Serial.print("%  loops per second: ");
+  Serial.println(1000000.0 * loop_count / elapsed, 0);
+  Serial.print("loop() work per iteration (us) avg: ");
+  Serial.print(loop_count > 1 ? loop_work_us / (loop_count - 1) : 0);
+  Serial.print("  max: ");
+  Serial.println(loop_work_max_us);
+
+  loop_wait_us = 0;
+  loop_work_us = 0;
+  loop_work_max_us = 0;
+  loop_count = 0;
+  loop_stats_start = micros();
+}
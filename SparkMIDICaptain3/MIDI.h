@@ -1,16 +1,81 @@
 #ifndef MIDI_h
   #define MIDI_h
 
+  // DIN MIDI is read by din_midi_task() straight from the IDF UART driver's event queue, so it is
+  // parsed as soon as the RX interrupt fires and doesn't wait for loop()
+  #include "driver/uart.h"
+
   #define SER_RX 16
-  HardwareSerial *ser1;
+  #define SER_TX 17                   // DIN MIDI out, for LED feedback
+  #define DIN_UART UART_NUM_1
+  #define DIN_UART_RX_BUF 256
+  #define DIN_UART_TX_BUF 256         // so writes don't wait for the 31250 baud line
+  #define DIN_UART_EVENTS 20
+  #define DIN_RX_FULL_THRESHOLD 3     // interrupt once a whole 3 byte message is in the FIFO
+  #define DIN_RX_TIMEOUT 2            // or after 2 byte times of silence, for 1 and 2 byte messages
+  #define DIN_TASK_PRIORITY 3         // above loop() so a long preset decode doesn't hold up DIN
+  #define DIN_POST_WAIT pdMS_TO_TICKS(50)  // longest a DIN message waits for space in the event queue - the
+                                           // RX buffer takes 80ms to fill, so nothing more is lost meanwhile
+
+  QueueHandle_t din_uart_queue;
+  TaskHandle_t din_task;
+  unsigned long din_overflows;
+
+  // where a MIDI message came from, with the time (micros()) its bytes arrived
+  enum midi_source_t {MIDI_SRC_DIN, MIDI_SRC_USB_S3, MIDI_SRC_USB_HOST, MIDI_SRC_BLE, MIDI_SRC_COUNT};
+  const char *midi_source_names[] {"SERIAL DIN MIDI", "USB S3", "USB HOST", "BLE"};
+
+  // every MIDI source posts complete messages to one queue, which loop() empties each time round
+  // The DIN task, the BLE notify callback and loop() all post, so the counters are updated atomically
+  #define MIDI_EVENT_QUEUE_SIZE 64
+
+  struct midi_event {
+    uint8_t source;                   // midi_source_t
+    uint8_t cable;                    // USB MIDI cable number, 0 for other sources
+    uint8_t port;                     // USB MIDI device slot, 0 for other sources
+    uint8_t msg[3];
+    unsigned long arrival;            // micros() when the bytes arrived
+  };
+
+  QueueHandle_t qMidiEvents;
+  unsigned long midi_events_posted;
+  unsigned long midi_events_dropped;
+  int midi_events_high_water;
 
 
   #ifdef USB_S3
+    // Several USB MIDI devices can be used at once behind a hub (the IDF needs CONFIG_USB_HOST_HUBS_SUPPORTED).
+    // Each has its own slot with its own transfers, and its slot number goes in midi_event.port
+    // A slot is set up in the USB client task, but only torn down in loop() by usb_midi_reap() - the client
+    // task just marks it gone - so usb_midi_send() never uses a slot being freed. Its transfers are flushed
+    // and each one is freed only after its callback has come back with a cancelled status.
+    #define USB_MIDI_MAX_DEVICES 4
+    #define MIDI_IN_BUFFERS 8
+
     #include <usb/usb_host.h>
     #include "show_desc.hpp"
     #include "usbhhelp.hpp"
 
-    RingBuffer USBHostBuf;
+    #include "UsbMidiQueue.h"
+
+    struct usb_midi_device {
+      bool in_use;
+      usb_device_handle_t handle;
+      uint8_t interface;                  // the MIDI streaming interface claimed
+      bool claimed;
+      bool ready;                         // IN and OUT endpoints set up
+      uint8_t in_ep, out_ep;
+      usb_transfer_t *in[MIDI_IN_BUFFERS];
+      usb_transfer_t *out;
+      volatile bool out_busy;
+      int in_flight;                      // IN transfers submitted and not called back for the last time
+      volatile bool gone;                 // unplugged - set by the client task
+      bool stopping;                      // loop() has flushed the endpoints and is waiting for the transfers
+    };
+
+    usb_midi_device usb_midi_devices[USB_MIDI_MAX_DEVICES];
+    volatile bool usb_midi_resend;        // a device has become ready - loop() resends the feedback
+    UsbMidiQueue usb_midi_packets;
   #endif
 
 
@@ -28,23 +93,111 @@
 
 #include "RingBuffer.h"
 
-#ifdef BLE_MIDI
-class MIDIState 
+// MIDI 1.0 byte stream parser - one per transport
+// Handles running status, realtime bytes in the middle of other messages, SysEx, 
+// and the 1, 2 and 3 byte channel and system common messages
+
+#define MIDI_SYSEX_MAX 64
+
+class MIDIParser 
 {
   public:
-    MIDIState() {};
-    void initialise(RingBuffer *rb);
-    bool process(byte mi_data[3]);
-
-    RingBuffer *midi_stream;
-    int midi_status;
-    int midi_cmd_count;
-    int midi_data_count;
-    int midi_data[2];
+    MIDIParser() { reset(); };
+    void reset();
+    bool parse(uint8_t b, uint8_t *msg);
+
+    int msg_len;                        // bytes in the message just returned, 0 for a SysEx
+    uint8_t sysex[MIDI_SYSEX_MAX];      // a completed SysEx, without the F0 and F7
+    int sysex_len;
+    bool sysex_overflow;
+
+  private:
+    uint8_t status;                     // 0 if no running status
+    uint8_t data[2];
+    int data_count;
+    int data_needed;
+    bool in_sysex;
 };
+
+// BLE-MIDI packet parser
+// A packet is a header byte (top bit set, timestamp bits 12-7) followed by MIDI messages, each 
+// preceded by a timestamp byte (top bit set, timestamp bits 6-0). A status byte always comes straight 
+// after a timestamp, so a top bit byte that doesn't is the next timestamp. Running status data can 
+// follow a complete message with or without its own timestamp, and a SysEx can run over several packets.
+// The timestamp is the sender's clock in ms, modulo 8192
+// Everything in a packet arrives at once, so realtime messages (clock) are given the packet's arrival less 
+// how far their timestamp is before the packet's last one, which keeps the spacing of clock ticks sent in
+// one connection interval. Other messages keep the packet's arrival - the dejitter works from the timestamp.
+
+#define BLE_MIDI_TS_MASK 0x1FFF
+#define BLE_MIDI_PACKET_SPAN_MS 100       // more than this between the first and last timestamps isn't believed
+
+int ble_ts_diff(int a, int b);
+
+class BLEMIDIParser 
+{
+  public:
+    BLEMIDIParser() { reset(); };
+    void reset();
+    void parse_packet(const uint8_t *p, int len, unsigned long arrival);
+    static int last_timestamp(const uint8_t *p, int len);
+
+    unsigned long packets;
+    unsigned long bad_packets;
+
+  private:
+    MIDIParser midi;
+};
+
+// Expression pedals send a steady stream of CCs, but BLE delivers them in bunches once per connection
+// interval. With BLE_MIDI_DEJITTER each CC is held back so that it is released at the sender's 
+// timestamp plus a fixed delay, which puts the original spacing back. Other messages are not held.
+// The delay is BLE_MIDI_DEJITTER_MS beyond the quickest message seen recently, so it needs to be more than
+// the pedal's connection interval (typically 7.5 to 15 ms) plus any extra jitter.
+
+//#define BLE_MIDI_DEJITTER
+#define BLE_MIDI_DEJITTER_MS 20
+#define BLE_MIDI_DEJITTER_WINDOW 2000     // ms - how long the quickest delay is remembered for, to follow clock drift
+#define BLE_MIDI_HOLD_QUEUE_SIZE 32
+
+class BLEMIDIDejitter 
+{
+  public:
+    BLEMIDIDejitter() { reset(); };
+    void reset();
+    unsigned long hold_us(int timestamp, unsigned long now_ms);
+
+  private:
+    int window_min;                     // quickest (local ms - timestamp) in this window
+    int last_window_min;                // and in the one before, -1 if none
+    unsigned long window_start;
+};
+
+struct ble_held_event {
+  struct midi_event ev;
+  unsigned long due;                    // micros() when it can go into the MIDI event queue
+};
+
+MIDIParser din_parser;
+#ifdef BLE_MIDI
+  BLEMIDIParser ble_midi;
+  #ifdef BLE_MIDI_DEJITTER
+    BLEMIDIDejitter ble_dejitter;
+    QueueHandle_t qBleHeld;
+  #endif
+#endif
+#ifdef USB_S3
+  MIDIParser usb_s3_parser[USB_MIDI_MAX_DEVICES];
+#endif
+#ifdef USB_HOST
+  MIDIParser usb_host_parser;
 #endif
 
   void setup_midi();
-  bool update_midi(byte *mid);
+  bool update_midi();
+  bool midi_event_post(int source, uint8_t *msg, unsigned long arrival, int cable = 0, int port = 0, TickType_t wait = 0);
+  bool next_midi_event(struct midi_event *ev);
+  unsigned long ble_midi_wait();
+  void midi_report();
 
 #endif
@@ -1,55 +1,225 @@
 #include "MIDI.h"
 
 //
-// MIDI State processing for BLE streams
+// MIDIParser class
 //
 
-#ifdef BLE_MIDI
-void MIDIState::initialise(RingBuffer *rb)
-{
-  midi_stream = rb;
-  midi_data_count = 0;
-  midi_cmd_count = 0;
-  midi_status = 0;
+void MIDIParser::reset() {
+  status = 0;
+  data_count = 0;
+  data_needed = 0;
+  in_sysex = false;
+  sysex_len = 0;
+  sysex_overflow = false;
+  msg_len = 0;
 }
 
-bool MIDIState::process(byte mi_data[3]) 
-{
-  byte b;
-  bool got_data;
+// data bytes needed after each status 0x80 to 0xFF, -1 for undefined or handled elsewhere
+const int8_t midi_data_len[] {
+  2, 2, 2, 2, 1, 1, 2, 2,                 // 0x80 to 0xF0 by top nibble  
+  -1, 1, 2, 1, -1, -1, 0, -1              // 0xF0 to 0xF7
+};
+
+// feed one byte in, returns true when msg[] holds a complete message
+// Note On with velocity 0 is returned as a Note Off, as that is what it means
+bool MIDIParser::parse(uint8_t b, uint8_t *msg) {
+  int len;
+
+  // realtime can appear anywhere, even inside a SysEx, and doesn't change anything
+  if (b >= 0xF8) {
+    if (b == 0xF9 || b == 0xFD) return false;
+    msg[0] = b;
+    msg[1] = 0;
+    msg[2] = 0;
+    msg_len = 1;
+    return true;
+  }
 
-  got_data = false;
-  
-  if (!midi_stream->is_empty()) {
-    midi_stream->get(&b);
-    
-    if (b <= 0x7F) {
-      midi_data[midi_data_count] = b;
-      midi_data_count++;
-      midi_cmd_count = 0;
-      if ((midi_status == 0xC0 || midi_status == 0xD0) || midi_data_count >= 2) {
-        mi_data[0] = midi_status;
-        mi_data[1] = midi_data[0];
-        if (midi_data_count == 2)
-          mi_data[2] = midi_data[1];
-        else
-          mi_data[2] = 0;
-        midi_data_count = 0;
-        got_data = true;
-      }
-    } 
+  if (b == 0xF0) {
+    in_sysex = true;
+    sysex_len = 0;
+    sysex_overflow = false;
+    status = 0;
+    return false;
+  }
+
+  if (b == 0xF7) {
+    if (!in_sysex) return false;
+    in_sysex = false;
+    msg[0] = 0xF0;
+    msg[1] = 0;
+    msg[2] = 0;
+    msg_len = 0;
+    return true;
+  }
+
+  if (b & 0x80) {
+    // any other status ends a SysEx without it being complete
+    in_sysex = false;
+    len = (b < 0xF0) ? midi_data_len[(b >> 4) - 8] : midi_data_len[8 + (b & 0x0F)];
+    if (len < 0) {
+      status = 0;
+      return false;
+    }
+    if (len == 0) {            // Tune Request
+      status = 0;
+      msg[0] = b;
+      msg[1] = 0;
+      msg[2] = 0;
+      msg_len = 1;
+      return true;
+    }
+    status = b;
+    data_needed = len;
+    data_count = 0;
+    return false;
+  }
+
+  // data byte
+  if (in_sysex) {
+    if (sysex_len < MIDI_SYSEX_MAX) 
+      sysex[sysex_len++] = b;
+    else
+      sysex_overflow = true;
+    return false;
+  }
+  if (status == 0) return false;     // no status to go with it
+
+  data[data_count++] = b;
+  if (data_count < data_needed) return false;
+
+  msg[0] = status;
+  msg[1] = data[0];
+  msg[2] = (data_needed == 2) ? data[1] : 0;
+  msg_len = data_needed + 1;
+  if ((status & 0xF0) == 0x90 && msg[2] == 0) 
+    msg[0] = 0x80 | (status & 0x0F);
+  data_count = 0;
+  if (status >= 0xF0) status = 0;    // system common messages don't have running status
+  return true;
+}
+
+
+//
+// BLEMIDIParser class
+//
+
+void BLEMIDIParser::reset() {
+  midi.reset();
+  packets = 0;
+  bad_packets = 0;
+}
+
+// the 13 bit timestamp of the last message in a packet, which is taken as sent when the packet arrived
+int BLEMIDIParser::last_timestamp(const uint8_t *p, int len) {
+  int i;
+  int ts_high, ts_low, last_ts_low;
+  bool last_was_timestamp;
+
+  ts_high = p[0] & 0x3F;
+  ts_low = 0;
+  last_ts_low = -1;
+  last_was_timestamp = false;
+  for (i = 1; i < len; i++) {
+    if ((p[i] & 0x80) && !last_was_timestamp) {
+      ts_low = p[i] & 0x7F;
+      if (ts_low < last_ts_low) 
+        ts_high = (ts_high + 1) & 0x3F;
+      last_ts_low = ts_low;
+      last_was_timestamp = true;
+    }
+    else
+      last_was_timestamp = false;
+  }
+  return (ts_high << 7) | ts_low;
+}
+
+// called from the BLE notify callback with one whole packet
+void BLEMIDIParser::parse_packet(const uint8_t *p, int len, unsigned long arrival) {
+  int i;
+  uint8_t b;
+  uint8_t msg[3];
+  int ts_high, ts_low, last_ts_low, ts, last_ts, before;
+  bool last_was_timestamp;
+
+  // header must have the top bit set and the next bit clear, and there must be something after it
+  if (len < 2 || (p[0] & 0xC0) != 0x80) {
+    bad_packets++;
+    return;
+  }
+  packets++;
+
+  last_ts = last_timestamp(p, len);
+  ts_high = p[0] & 0x3F;
+  ts_low = 0;
+  last_ts_low = -1;
+  last_was_timestamp = false;
+
+  for (i = 1; i < len; i++) {
+    b = p[i];
+    if ((b & 0x80) && !last_was_timestamp) {
+      // timestamp - the low 7 bits going backwards means the high bits have moved on
+      ts_low = b & 0x7F;
+      if (ts_low < last_ts_low) 
+        ts_high = (ts_high + 1) & 0x3F;
+      last_ts_low = ts_low;
+      last_was_timestamp = true;
+    }
     else {
-      midi_cmd_count++;
-      if (midi_cmd_count > 1) {
-        midi_status = b;            // the last byte before a non-cmd byte will always be status unless it was a single timestamp
+      last_was_timestamp = false;
+      if (midi.parse(b, msg)) {
+        ts = (ts_high << 7) | ts_low;
+        before = ble_ts_diff(last_ts, ts);
+        if (msg[0] >= 0xF8 && before > 0 && before <= BLE_MIDI_PACKET_SPAN_MS) 
+          ble_midi_message(msg, ts, arrival - before * 1000UL);
+        else
+          ble_midi_message(msg, ts, arrival);
       }
     }
-  } 
-  return got_data;
+  }
 }
 
-MIDIState ble_midi;
-#endif
+
+//
+// BLEMIDIDejitter class
+//
+
+// difference of two 13 bit timestamps, allowing for wrap
+int ble_ts_diff(int a, int b) {
+  return ((a - b + 4096) & BLE_MIDI_TS_MASK) - 4096;
+}
+
+void BLEMIDIDejitter::reset() {
+  window_min = -1;
+  last_window_min = -1;
+  window_start = 0;
+}
+
+// how long to hold a message sent at timestamp, which has arrived at now_ms
+// (now_ms - timestamp) is the sender's clock offset plus the transit time - the quickest one recently 
+// is taken as the offset plus the best transit time, and anything slower than that is held back less
+unsigned long BLEMIDIDejitter::hold_us(int timestamp, unsigned long now_ms) {
+  int delay, quickest, late;
+
+  delay = (now_ms - timestamp) & BLE_MIDI_TS_MASK;
+  
+  if (window_min < 0 || now_ms - window_start > BLE_MIDI_DEJITTER_WINDOW) {
+    last_window_min = window_min;
+    window_min = delay;
+    window_start = now_ms;
+  }
+  else if (ble_ts_diff(delay, window_min) < 0)
+    window_min = delay;
+
+  quickest = window_min;
+  if (last_window_min >= 0 && ble_ts_diff(last_window_min, quickest) < 0) 
+    quickest = last_window_min;
+
+  late = ble_ts_diff(delay, quickest);
+  if (late < 0) late = 0;
+  if (late >= BLE_MIDI_DEJITTER_MS) return 0;
+  return (BLE_MIDI_DEJITTER_MS - late) * 1000UL;
+}
 
 
 //
@@ -57,13 +227,12 @@ MIDIState ble_midi;
 //
 #ifdef USB_S3
 
-bool isMIDI = false;
-bool isMIDIReady = false;
-
-const size_t MIDI_IN_BUFFERS = 8;
-const size_t MIDI_OUT_BUFFERS = 8;
-usb_transfer_t *MIDIOut = NULL;
-usb_transfer_t *MIDIIn[MIDI_IN_BUFFERS] = {NULL};
+// device handle to slot, -1 if it isn't one of ours
+int usb_midi_slot(usb_device_handle_t handle) {
+  for (int d = 0; d < USB_MIDI_MAX_DEVICES; d++)
+    if (usb_midi_devices[d].in_use && usb_midi_devices[d].handle == handle) return d;
+  return -1;
+}
 
 // USB MIDI Event Packet Format (always 4 bytes)
 //
@@ -76,35 +245,75 @@ usb_transfer_t *MIDIIn[MIDI_IN_BUFFERS] = {NULL};
 // See Table 4-1 in the MIDI 1.0 spec at usb.org.
 //
 
+// number of MIDI bytes in a USB MIDI event packet, by CIN
+const uint8_t usb_midi_cin_len[] {0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1};
+
 static void midi_transfer_cb(usb_transfer_t *transfer)
 {
-  ESP_LOGI("", "midi_transfer_cb context: %d", transfer->context);
-  if (Device_Handle == transfer->device_handle) {
-    int in_xfer = transfer->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK;
-    if ((transfer->status == 0) && in_xfer) {
-      uint8_t *const p = transfer->data_buffer;
-      for (int i = 0; i < transfer->actual_num_bytes; i += 4) {
-        if ((p[i] + p[i+1] + p[i+2] + p[i+3]) == 0) break;
-        ESP_LOGI("", "midi: %02x %02x %02x %02x",
-            p[i], p[i+1], p[i+2], p[i+3]);
-
-        USBHostBuf.add(p[i+1]);
-        USBHostBuf.add(p[i+2]);
-        USBHostBuf.add(p[i+3]);
-        USBHostBuf.commit();
-      }
-      esp_err_t err = usb_host_transfer_submit(transfer);
-      if (err != ESP_OK) {
-        ESP_LOGI("", "usb_host_transfer_submit In fail: %x", err);
-      }
+  int d = (intptr_t) transfer->context;        // device slot
+  usb_midi_device *dev = &usb_midi_devices[d];
+
+  if (transfer->status == 0 && !dev->gone) {
+    uint8_t *const p = transfer->data_buffer;
+    unsigned long arrival = micros();
+    for (int i = 0; i < transfer->actual_num_bytes; i += 4) {
+      if ((p[i] + p[i+1] + p[i+2] + p[i+3]) == 0) break;
+      ESP_LOGI("", "midi %d: %02x %02x %02x %02x", d,
+          p[i], p[i+1], p[i+2], p[i+3]);
+      usb_midi_packets.push(&p[i], d, arrival);
     }
-    else {
-      ESP_LOGI("", "transfer->status %d", transfer->status);
+    loop_signal(EV_MIDI_USB);
+    esp_err_t err = usb_host_transfer_submit(transfer);
+    if (err == ESP_OK) return;
+    ESP_LOGI("", "usb_host_transfer_submit In fail: %x", err);
+  }
+  else {
+    // the device has gone, or the transfer was cancelled
+    ESP_LOGI("", "transfer->status %d", transfer->status);
+  }
+  // not submitted again - the last thing done with it here, as usb_midi_reap() can free it after this
+  __atomic_sub_fetch(&dev->in_flight, 1, __ATOMIC_RELEASE);
+  loop_signal(EV_MIDI_USB);
+}
+
+static void midi_out_cb(usb_transfer_t *transfer)
+{
+  int d = (intptr_t) transfer->context;
+
+  if (transfer->status != 0) {
+    ESP_LOGI("", "midi_out_cb transfer->status %d", transfer->status);
+  }
+  usb_midi_devices[d].out_busy = false;
+  loop_signal(EV_MIDI_USB);               // in case loop() has more waiting to go out
+}
+
+// send USB-MIDI event packets in one bulk transfer to every device
+// false if any of them is still busy with the last one, so that nobody misses out
+bool usb_midi_send(uint8_t *buf, int len) {
+  int d, n;
+  usb_midi_device *dev;
+
+  for (d = 0; d < USB_MIDI_MAX_DEVICES; d++) 
+    if (usb_midi_devices[d].ready && usb_midi_devices[d].out_busy) return false;
+
+  for (d = 0; d < USB_MIDI_MAX_DEVICES; d++) {
+    dev = &usb_midi_devices[d];
+    if (!dev->ready) continue;
+    n = (len > dev->out->data_buffer_size) ? dev->out->data_buffer_size : len;
+    memcpy(dev->out->data_buffer, buf, n);
+    dev->out->num_bytes = n;
+    dev->out_busy = true;
+    esp_err_t err = usb_host_transfer_submit(dev->out);
+    if (err != ESP_OK) {
+      dev->out_busy = false;
+      ESP_LOGI("", "usb_host_transfer_submit Out fail: %x", err);
     }
   }
+  return true;
 }
 
-void check_interface_desc_MIDI(const void *p)
+// true if this is a MIDI streaming interface, which is then claimed for the device
+bool check_interface_desc_MIDI(usb_midi_device *dev, const void *p)
 {
   const usb_intf_desc_t *intf = (const usb_intf_desc_t *)p;
 
@@ -113,17 +322,24 @@ void check_interface_desc_MIDI(const void *p)
       (intf->bInterfaceSubClass == 3) &&
       (intf->bInterfaceProtocol == 0))
   {
-    isMIDI = true;
     ESP_LOGI("", "Claiming a MIDI device!");
-    esp_err_t err = usb_host_interface_claim(Client_Handle, Device_Handle,
+    esp_err_t err = usb_host_interface_claim(Client_Handle, dev->handle,
         intf->bInterfaceNumber, intf->bAlternateSetting);
-    if (err != ESP_OK) ESP_LOGI("", "usb_host_interface_claim failed: %x", err);
+    if (err != ESP_OK) {
+      ESP_LOGI("", "usb_host_interface_claim failed: %x", err);
+      return false;
+    }
+    dev->interface = intf->bInterfaceNumber;
+    dev->claimed = true;
+    return true;
   }
+  return false;
 }
 
-void prepare_endpoints(const void *p)
+void prepare_endpoints(int d, const void *p)
 {
   const usb_ep_desc_t *endpoint = (const usb_ep_desc_t *)p;
+  usb_midi_device *dev = &usb_midi_devices[d];
   esp_err_t err;
 
   // must be bulk for MIDI
@@ -132,44 +348,144 @@ void prepare_endpoints(const void *p)
     return;
   }
   if (endpoint->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) {
+    if (dev->in[0] != NULL) return;
+    dev->in_ep = endpoint->bEndpointAddress;
     for (int i = 0; i < MIDI_IN_BUFFERS; i++) {
-      err = usb_host_transfer_alloc(endpoint->wMaxPacketSize, 0, &MIDIIn[i]);
+      err = usb_host_transfer_alloc(endpoint->wMaxPacketSize, 0, &dev->in[i]);
       if (err != ESP_OK) {
-        MIDIIn[i] = NULL;
+        dev->in[i] = NULL;
         ESP_LOGI("", "usb_host_transfer_alloc In fail: %x", err);
       }
       else {
-        MIDIIn[i]->device_handle = Device_Handle;
-        MIDIIn[i]->bEndpointAddress = endpoint->bEndpointAddress;
-        MIDIIn[i]->callback = midi_transfer_cb;
-        MIDIIn[i]->context = (void *)i;
-        MIDIIn[i]->num_bytes = endpoint->wMaxPacketSize;
-        esp_err_t err = usb_host_transfer_submit(MIDIIn[i]);
+        dev->in[i]->device_handle = dev->handle;
+        dev->in[i]->bEndpointAddress = endpoint->bEndpointAddress;
+        dev->in[i]->callback = midi_transfer_cb;
+        dev->in[i]->context = (void *) (intptr_t) d;
+        dev->in[i]->num_bytes = endpoint->wMaxPacketSize;
+        __atomic_add_fetch(&dev->in_flight, 1, __ATOMIC_RELAXED);
+        esp_err_t err = usb_host_transfer_submit(dev->in[i]);
         if (err != ESP_OK) {
+          __atomic_sub_fetch(&dev->in_flight, 1, __ATOMIC_RELAXED);
           ESP_LOGI("", "usb_host_transfer_submit In fail: %x", err);
         }
       }
     }
   }
   else {
-    err = usb_host_transfer_alloc(endpoint->wMaxPacketSize, 0, &MIDIOut);
+    if (dev->out != NULL) return;
+    err = usb_host_transfer_alloc(endpoint->wMaxPacketSize, 0, &dev->out);
     if (err != ESP_OK) {
-      MIDIOut = NULL;
+      dev->out = NULL;
       ESP_LOGI("", "usb_host_transfer_alloc Out fail: %x", err);
       return;
     }
-    ESP_LOGI("", "Out data_buffer_size: %d", MIDIOut->data_buffer_size);
-    MIDIOut->device_handle = Device_Handle;
-    MIDIOut->bEndpointAddress = endpoint->bEndpointAddress;
-    MIDIOut->callback = midi_transfer_cb;
-    MIDIOut->context = NULL;
-//    MIDIOut->flags |= USB_TRANSFER_FLAG_ZERO_PACK;
-  }
-  isMIDIReady = ((MIDIOut != NULL) && (MIDIIn[0] != NULL));
+    ESP_LOGI("", "Out data_buffer_size: %d", dev->out->data_buffer_size);
+    dev->out_ep = endpoint->bEndpointAddress;
+    dev->out->device_handle = dev->handle;
+    dev->out->bEndpointAddress = endpoint->bEndpointAddress;
+    dev->out->callback = midi_out_cb;
+    dev->out->context = (void *) (intptr_t) d;
+//    dev->out->flags |= USB_TRANSFER_FLAG_ZERO_PACK;
+  }
+  if (!dev->ready && dev->out != NULL && dev->in[0] != NULL) {
+    dev->out_busy = false;
+    dev->ready = true;
+    usb_s3_parser[d].reset();
+    usb_midi_resend = true;               // loop() brings the new controller's LEDs up to date
+    loop_signal(EV_MIDI_USB);
+  }
 }
 
-void show_config_desc_full(const usb_config_desc_t *config_desc)
+// a device has been unplugged - in the client task, so only mark it for usb_midi_reap()
+void usb_midi_device_gone(usb_device_handle_t handle)
 {
+  int d = usb_midi_slot(handle);
+  usb_midi_device *dev;
+
+  if (d < 0) {
+    usb_host_device_close(Client_Handle, handle);
+    return;
+  }
+  dev = &usb_midi_devices[d];
+  dev->ready = false;
+  dev->gone = true;
+  loop_signal(EV_MIDI_USB);
+  ESP_LOGI("", "USB MIDI device %d gone", d);
+}
+
+// free the slots of unplugged devices - in loop(), so never while usb_midi_send() is using one
+// the endpoints are flushed first, and the transfers freed on a later call once all their callbacks are back
+void usb_midi_reap() {
+  usb_midi_device *dev;
+  int d, i;
+
+  for (d = 0; d < USB_MIDI_MAX_DEVICES; d++) {
+    dev = &usb_midi_devices[d];
+    if (!dev->gone) continue;
+
+    if (!dev->stopping) {
+      dev->stopping = true;
+      if (dev->claimed) {
+        if (dev->in[0] != NULL) {
+          usb_host_endpoint_halt(dev->handle, dev->in_ep);
+          usb_host_endpoint_flush(dev->handle, dev->in_ep);
+        }
+        if (dev->out != NULL) {
+          usb_host_endpoint_halt(dev->handle, dev->out_ep);
+          usb_host_endpoint_flush(dev->handle, dev->out_ep);
+        }
+      }
+    }
+    if (__atomic_load_n(&dev->in_flight, __ATOMIC_ACQUIRE) > 0 || dev->out_busy) continue;
+
+    if (dev->claimed) {
+      if (dev->in[0] != NULL) usb_host_endpoint_clear(dev->handle, dev->in_ep);
+      if (dev->out != NULL) usb_host_endpoint_clear(dev->handle, dev->out_ep);
+      usb_host_interface_release(Client_Handle, dev->handle, dev->interface);
+    }
+    for (i = 0; i < MIDI_IN_BUFFERS; i++) 
+      if (dev->in[i] != NULL) usb_host_transfer_free(dev->in[i]);
+    if (dev->out != NULL) usb_host_transfer_free(dev->out);
+    usb_host_device_close(Client_Handle, dev->handle);
+
+    // usb_midi_device_new() clears the rest when it takes the slot again
+    dev->gone = false;
+    dev->stopping = false;
+    __atomic_store_n(&dev->in_use, false, __ATOMIC_RELEASE);
+    DEB("USB MIDI device freed ");
+    DEBUG(d);
+  }
+}
+
+// called for each new device with its configuration descriptor
+void usb_midi_device_new(usb_device_handle_t handle, const usb_config_desc_t *config_desc)
+{
+  int d;
+
+  for (d = 0; d < USB_MIDI_MAX_DEVICES && __atomic_load_n(&usb_midi_devices[d].in_use, __ATOMIC_ACQUIRE); d++);
+  if (d == USB_MIDI_MAX_DEVICES) {
+    ESP_LOGI("", "No room for another USB MIDI device");
+    usb_host_device_close(Client_Handle, handle);
+    return;
+  }
+  memset(&usb_midi_devices[d], 0, sizeof(usb_midi_device));
+  usb_midi_devices[d].in_use = true;
+  usb_midi_devices[d].handle = handle;
+
+  show_config_desc_full(d, config_desc);
+
+  // not a MIDI device (a hub, or something else) - let it go
+  if (!usb_midi_devices[d].claimed) {
+    usb_midi_devices[d].in_use = false;
+    usb_host_device_close(Client_Handle, handle);
+  }
+}
+
+void show_config_desc_full(int d, const usb_config_desc_t *config_desc)
+{
+  usb_midi_device *dev = &usb_midi_devices[d];
+  bool midi_intf = false;                 // the endpoints after a MIDI interface belong to it
+
   // Full decode of config desc.
   const uint8_t *p = &config_desc->val[0];
   uint8_t bLength;
@@ -189,12 +505,12 @@ void show_config_desc_full(const usb_config_desc_t *config_desc)
           break;
         case USB_B_DESCRIPTOR_TYPE_INTERFACE:
           show_interface_desc(p);
-          if (!isMIDI) check_interface_desc_MIDI(p);
+          midi_intf = !dev->claimed && check_interface_desc_MIDI(dev, p);
           break;
         case USB_B_DESCRIPTOR_TYPE_ENDPOINT:
           show_endpoint_desc(p);
-          if (isMIDI && !isMIDIReady) {
-            prepare_endpoints(p);
+          if (midi_intf) {
+            prepare_endpoints(d, p);
           }
           break;
         case USB_B_DESCRIPTOR_TYPE_DEVICE_QUALIFIER:
@@ -221,20 +537,104 @@ void show_config_desc_full(const usb_config_desc_t *config_desc)
   }
 }
 
-
 #endif
 
 
 
 
 
+//
+// DIN MIDI on UART 1
+//
+
+// read whatever the driver has buffered and post each complete message
+// if the event queue is full the task blocks on it until loop() has made space, while the driver keeps 
+// buffering, and after DIN_POST_WAIT the message is dropped and counted
+void din_read(unsigned long arrival) {
+  uint8_t b;
+  uint8_t mid[3];
+  size_t waiting;
+
+  uart_get_buffered_data_len(DIN_UART, &waiting);
+  while (waiting > 0) {
+    if (uart_read_bytes(DIN_UART, &b, 1, 0) != 1) break;
+    waiting--;
+    if (din_parser.parse(b, mid)) {
+      TRACE(TR_MIDI_DIN, mid[0] << 8 | mid[1]);
+      midi_event_post(MIDI_SRC_DIN, mid, arrival, 0, 0, DIN_POST_WAIT);
+      loop_signal(EV_MIDI_DIN);
+    }
+  }
+}
+
+void din_midi_task(void *param) {
+  uart_event_t event;
+
+  while (true) {
+    if (xQueueReceive(din_uart_queue, &event, portMAX_DELAY) != pdTRUE) continue;
+
+    switch (event.type) {
+      case UART_DATA:
+        din_read(micros());
+        break;
+      case UART_FIFO_OVF:
+      case UART_BUFFER_FULL:
+        // bytes have been lost so whatever was part-parsed is rubbish
+        din_overflows++;
+        uart_flush_input(DIN_UART);
+        xQueueReset(din_uart_queue);
+        din_parser.reset();
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// queue bytes for DIN MIDI out - the driver's TX buffer sends them in the background
+bool din_midi_send(uint8_t *buf, int len) {
+  return uart_write_bytes(DIN_UART, buf, len) == len;
+}
+
+void setup_din_midi() {
+  uart_config_t uart_config = {
+    .baud_rate = 31250,
+    .data_bits = UART_DATA_8_BITS,
+    .parity = UART_PARITY_DISABLE,
+    .stop_bits = UART_STOP_BITS_1,
+    .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+    .rx_flow_ctrl_thresh = 0,
+    .source_clk = UART_SCLK_DEFAULT,
+  };
+
+  din_overflows = 0;
+  uart_driver_install(DIN_UART, DIN_UART_RX_BUF, DIN_UART_TX_BUF, DIN_UART_EVENTS, &din_uart_queue, 0);
+  uart_param_config(DIN_UART, &uart_config);
+  uart_set_pin(DIN_UART, SER_TX, SER_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+  uart_set_rx_full_threshold(DIN_UART, DIN_RX_FULL_THRESHOLD);
+  uart_set_rx_timeout(DIN_UART, DIN_RX_TIMEOUT);
+  uart_flush_input(DIN_UART);
+
+  xTaskCreatePinnedToCore(din_midi_task, "din_midi", 3072, NULL, DIN_TASK_PRIORITY, &din_task, ARDUINO_RUNNING_CORE);
+}
+
+
+
 //
 // Main MIDI setup and loop
 //
 
 
 void setup_midi() {
-  byte b;
+
+  qMidiEvents = xQueueCreate(MIDI_EVENT_QUEUE_SIZE, sizeof (struct midi_event));
+  midi_events_posted = 0;
+  midi_events_dropped = 0;
+  midi_events_high_water = 0;
+
+#if defined BLE_MIDI && defined BLE_MIDI_DEJITTER
+  qBleHeld = xQueueCreate(BLE_MIDI_HOLD_QUEUE_SIZE, sizeof (struct ble_held_event));
+#endif
 
 #ifdef USB_HOST
   if (Usb.Init() == -1) {
@@ -248,102 +648,212 @@ void setup_midi() {
 #endif
 
 #ifdef USB_S3
-  usbh_setup(show_config_desc_full);
+  usbh_setup(usb_midi_device_new, usb_midi_device_gone);
 #endif
 
+  setup_din_midi();
+}
 
-#ifdef BLE_MIDI
-  ble_midi.initialise(&midi_in);
+// channel and system common messages are used for actions, and clock, start, continue and stop for 
+// the tempo - SysEx and the rest of realtime are dropped here
+bool midi_wanted(byte *mid) {
+  return (mid[0] < 0xF8 && mid[0] != 0xF0) || mid[0] == 0xF8 || (mid[0] >= 0xFA && mid[0] <= 0xFC);
+}
+
+// add a complete message to the MIDI event queue, false if the queue was full and it was lost
+bool midi_event_post(int source, uint8_t *msg, unsigned long arrival, int cable, int port, TickType_t wait) {
+  struct midi_event ev;
+  int waiting, high;
+
+  if (!midi_wanted(msg)) return true;
+
+  ev.source = source;
+  ev.cable = cable;
+  ev.port = port;
+  ev.msg[0] = msg[0];
+  ev.msg[1] = msg[1];
+  ev.msg[2] = msg[2];
+  ev.arrival = arrival;
+
+  if (xQueueSend(qMidiEvents, &ev, wait) != pdTRUE) {
+    __atomic_add_fetch(&midi_events_dropped, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+  __atomic_add_fetch(&midi_events_posted, 1, __ATOMIC_RELAXED);
+  waiting = uxQueueMessagesWaiting(qMidiEvents);
+  high = __atomic_load_n(&midi_events_high_water, __ATOMIC_RELAXED);
+  while (waiting > high && 
+         !__atomic_compare_exchange_n(&midi_events_high_water, &high, waiting, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return true;
+}
+
+// take the next message from the MIDI event queue, false if it is empty
+bool next_midi_event(struct midi_event *ev) {
+  if (xQueueReceive(qMidiEvents, ev, (TickType_t) 0) != pdTRUE) 
+    return false;
+  if (ev->msg[0] >= 0xF8) return true;      // too many clock messages to print
+
+  DEB("MIDI (");
+  DEB(midi_source_names[ev->source]);
+  if (ev->port > 0) {
+    DEB(" ");
+    DEB(ev->port);
+  }
+  DEB(") 0x");
+  DEB(ev->msg[0], HEX);
+  DEB(" ");
+  DEB(ev->msg[1]);
+  DEB(" ");   
+  DEBUG(ev->msg[2]);
+  return true;
+}
+
+// a complete message from ble_midi, in the BLE notify callback
+void ble_midi_message(uint8_t *msg, int timestamp, unsigned long arrival) {
+  TRACE(TR_MIDI_BLE, msg[0] << 8 | msg[1]);
+
+#ifdef BLE_MIDI_DEJITTER
+  struct ble_held_event held;
+  unsigned long hold;
+
+  if ((msg[0] & 0xF0) == 0xB0) {
+    hold = ble_dejitter.hold_us(timestamp, millis());
+    if (hold > 0) {
+      held.ev.source = MIDI_SRC_BLE;
+      held.ev.msg[0] = msg[0];
+      held.ev.msg[1] = msg[1];
+      held.ev.msg[2] = msg[2];
+      held.ev.arrival = arrival;
+      held.due = arrival + hold;
+      if (xQueueSend(qBleHeld, &held, (TickType_t) 0) == pdTRUE) return;
+      // if the hold queue is full send it straight on
+    }
+  }
+#endif
+  midi_event_post(MIDI_SRC_BLE, msg, arrival);
+}
+
+// how many ms until the next held BLE message is due, so loop() knows how long it can sleep
+unsigned long ble_midi_wait() {
+#if defined BLE_MIDI && defined BLE_MIDI_DEJITTER
+  struct ble_held_event held;
+  long left;
+
+  if (xQueuePeek(qBleHeld, &held, (TickType_t) 0) == pdTRUE) {
+    left = (long) (held.due - micros());
+    return left <= 0 ? 0 : (left + 999) / 1000;
+  }
 #endif
+  return LOOP_MAX_WAIT;
+}
 
-  ser1 = new HardwareSerial(1); 
-  ser1->begin(31250, SERIAL_8N1, SER_RX, -1);
-  while (ser1->available())
-    b = ser1->read();
+// true if another message can be posted - a source is only read while this is true, so a burst 
+// bigger than the queue stays in the source buffer until next time rather than being lost
+bool midi_event_space() {
+  return uxQueueSpacesAvailable(qMidiEvents) > 0;
 }
 
-bool update_midi(byte *mid) {
-  bool got_midi;
+// read everything waiting from every MIDI source and post each complete message to the queue
+// returns true if the queue filled up with some MIDI still waiting
+bool update_midi() {
   byte b;
-  char *midi_source;
-  
-  midi_source = "";
-  got_midi = false;
+  byte mid[3];
 
-#ifdef BLE_MIDI
-  // BLE MIDI controller
-  if (ble_midi.process(mid)) got_midi = true;
+#if defined BLE_MIDI && defined BLE_MIDI_DEJITTER
+  // BLE MIDI messages are posted from notifyCB_pedal() - only the held back CCs are released here
+  struct ble_held_event held;
+
+  while (midi_event_space() && xQueuePeek(qBleHeld, &held, (TickType_t) 0) == pdTRUE 
+         && (long) (held.due - micros()) <= 0) {
+    xQueueReceive(qBleHeld, &held, (TickType_t) 0);
+    midi_event_post(MIDI_SRC_BLE, held.ev.msg, held.ev.arrival);
+  }
 #endif
 
 
 #ifdef USB_HOST
-  // USB MIDI  
+  // USB MIDI - RecvData() takes the bytes out of the library, so these are all posted
   if (usb_connected) {
     Usb.Task();
 
-    if (Midi) {                                                  // USB Midi
+    if (Midi && midi_event_space()) {                            // USB Midi
       rcvd = Midi.RecvData(midi_buf, false);
-      if (rcvd > 0) Serial.println("Got some USB midi data");
-      if (rcvd > 0 && !(midi_buf[0] == 0 && midi_buf[1] == 0 && midi_buf[2] == 0)) {
-        mid[0] = midi_buf[0];
-        mid[1] = midi_buf[1];
-        mid[2] = midi_buf[2];
-        midi_source = "USB HOST";
-        got_midi = true;
+      for (int i = 0; i < rcvd; i++) {
+        if (usb_host_parser.parse(midi_buf[i], mid)) {
+          TRACE(TR_MIDI_USB, mid[0] << 8 | mid[1]);
+          midi_event_post(MIDI_SRC_USB_HOST, mid, micros());
+        }
       }
     }
   }
 #endif
 
 #ifdef USB_S3
-  usbh_task();
-
-  if (!USBHostBuf.is_empty()) {
-    if (USBHostBuf.get_data_len() >= 3) {
-      USBHostBuf.get(&mid[0]);
-      USBHostBuf.get(&mid[1]);
-      USBHostBuf.get(&mid[2]);
-      midi_source = "USB S3";
-      got_midi = true;
-    }
-    else
-    { // not at least three bytes in the buffer - this can't be right, should always be a multiple of three
-      USBHostBuf.clear();
-      Serial.println("Cleared S3 USB Host circular buffer!");
-    }
-    got_midi = true;
+  usb_midi_reap();
+  if (usb_midi_resend) {
+    usb_midi_resend = false;
+    midi_feedback_resend(MIDI_OUT_USB);       // DIN has already been told
   }
-  
 
-#endif
-
-  // Serial 1 - DIN MIDI
-  if (ser1->available()) {
-    mid[0] = ser1->read();
-    mid[1] = ser1->read();
-    
-    if (mid[0] == 0xC0 || mid[0] == 0xD0)
-      mid[2] = 0;
-    else 
-      mid[2] = ser1->read();
-      
-    if (mid[0] != 0xFE) {
-      midi_source = "SERIAL DIN MIDI";
-      got_midi = true;
+  // whole USB MIDI event packets from midi_transfer_cb() - the CIN says how many of the MIDI bytes are real
+  // each device has its own parser, so a SysEx from one can't swallow messages from another
+  struct usb_midi_packet pk;
+  int cable;
+
+  while (midi_event_space() && usb_midi_packets.pop(&pk)) {
+    cable = pk.p[0] >> 4;
+    for (int j = 0; j < usb_midi_cin_len[pk.p[0] & 0x0f]; j++) {
+      if (usb_s3_parser[pk.port].parse(pk.p[1 + j], mid)) {
+        TRACE(TR_MIDI_USB, mid[0] << 8 | mid[1]);
+        midi_event_post(MIDI_SRC_USB_S3, mid, pk.arrival, cable, pk.port);
+      }
     }
   }
+#endif
 
+  // DIN MIDI is posted by din_midi_task()
 
-  if (got_midi) {
-    Serial.print("MIDI (");
-    Serial.print(midi_source);
-    Serial.print(") 0x");
-    Serial.print(mid[0], HEX);
-    Serial.print(" ");
-    Serial.print(mid[1]);
-    Serial.print(" ");   
-    Serial.println(mid[2]);
-  }
-  
-  return got_midi;
+  return !midi_event_space();
 }
+
+void midi_report() {
+  Serial.print("MIDI events posted: ");
+  Serial.print(midi_events_posted);
+  Serial.print("  dropped: ");
+  Serial.print(midi_events_dropped);
+  Serial.print("  queue high water: ");
+  Serial.print(midi_events_high_water);
+  Serial.print("/");
+  Serial.print(MIDI_EVENT_QUEUE_SIZE);
+  Serial.print("  DIN overflows: ");
+  Serial.println(din_overflows);
+  Serial.print("MIDI out transfers: ");
+  Serial.print(midi_out_transfers);
+  Serial.print("  dropped: ");
+  Serial.print(midi_out_dropped);
+  Serial.print("  USB busy: ");
+  Serial.println(midi_out_busy);
+#ifdef USB_S3
+  Serial.print("USB MIDI packets: ");
+  Serial.print(usb_midi_packets.pushed);
+  Serial.print("  overflows: ");
+  Serial.print(usb_midi_packets.overflows);
+  Serial.print("  queue high water: ");
+  Serial.print(usb_midi_packets.high_water);
+  Serial.print("/");
+  Serial.println(USB_MIDI_QUEUE_SIZE);
+  for (int d = 0; d < USB_MIDI_MAX_DEVICES; d++) {
+    if (usb_midi_devices[d].ready) {
+      Serial.print("USB MIDI device ");
+      Serial.print(d);
+      Serial.println(" ready");
+    }
+  }
+#endif
+#ifdef BLE_MIDI
+  Serial.print("BLE MIDI packets: ");
+  Serial.print(ble_midi.packets);
+  Serial.print("  bad packets: ");
+  Serial.println(ble_midi.bad_packets);
+#endif
+}
\ No newline at end of file
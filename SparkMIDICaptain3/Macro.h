@@ -0,0 +1,51 @@
+#ifndef Macro_h
+#define Macro_h
+
+// Macros - several changes from one footswitch
+//
+// The steps are applied to a copy of the current preset, then compared with it, and a message is queued for
+// each thing that ends up different: model changes first, then on/off, then parameters. They all go into the
+// batches that flush_sparkIO() sends, so a macro is a BLE write or two rather than one per change, and
+// presets[CUR_EDITING] is written once at the end. A step that changes nothing sends nothing. Each model
+// change still goes on its own and waits for model_change_settle() before anything else is sent.
+// A model must be in the catalog for its slot (see Models.h) - it is set up by model_set() and all its
+// values are sent, and a parameter step for an index the model doesn't have is skipped.
+// macro1 to macro4 in the mapping run macros[0] to macros[3].
+
+enum macro_step_t {MACRO_MODEL, MACRO_ON, MACRO_OFF, MACRO_TOGGLE, MACRO_PARAM, MACRO_END};
+
+struct macro_step {
+  macro_step_t type;
+  int slot;                               // 0 noisegate to 6 reverb
+  int param;                              // MACRO_PARAM only
+  float val;                              // MACRO_PARAM only
+  const char *model;                      // MACRO_MODEL only
+};
+
+#define MACRO_MAX_STEPS 12
+
+struct macro {
+  const char *name;
+  macro_step steps[MACRO_MAX_STEPS];      // up to the first MACRO_END
+};
+
+const macro macros[] {
+  {"Lead",  {{MACRO_MODEL, 3, 0, 0.0, "OrangeAD30"},
+             {MACRO_ON,    2},
+             {MACRO_ON,    5},
+             {MACRO_PARAM, 3, AMP_GAIN, 0.8},
+             {MACRO_END}}},
+  {"Clean", {{MACRO_MODEL, 3, 0, 0.0, "Twin"},
+             {MACRO_OFF,   2},
+             {MACRO_OFF,   5},
+             {MACRO_PARAM, 3, AMP_GAIN, 0.4},
+             {MACRO_END}}},
+};
+const int num_macros = sizeof(macros) / sizeof(macro);
+
+unsigned long macro_runs;
+unsigned long macro_messages;
+
+void run_macro(int num);
+
+#endif
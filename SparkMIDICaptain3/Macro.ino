@@ -0,0 +1,87 @@
+#include "Macro.h"
+
+void run_macro(int num) {
+  SparkPreset *cur;
+  SparkPreset::SparkEffects fx_new[7], *fx;
+  const macro_step *st;
+  const spark_model *m;
+  int slot, param, sent;
+  bool new_model;
+
+  if (num < 0 || num >= num_macros) return;
+  cur = &presets[CUR_EDITING][current_input];
+  memcpy(fx_new, cur->effects, sizeof(fx_new));
+
+  // apply the steps to a copy of the effects
+  for (st = macros[num].steps; st < &macros[num].steps[MACRO_MAX_STEPS] && st->type != MACRO_END; st++) {
+    if (st->slot < 0 || st->slot > 6) continue;
+    fx = &fx_new[st->slot];
+    switch (st->type) {
+      case MACRO_MODEL:  m = model_find(st->model);
+                         if (m == NULL || m->slot != st->slot) {
+                           DEB("Macro model not in the catalog for the slot: ");
+                           DEBUG(st->model);
+                           break;
+                         }
+                         if (strcmp(fx->EffectName, m->name) != 0) model_set(fx, m);
+                         break;
+      case MACRO_ON:     fx->OnOff = true;
+                         break;
+      case MACRO_OFF:    fx->OnOff = false;
+                         break;
+      case MACRO_TOGGLE: fx->OnOff = !fx->OnOff;
+                         break;
+      case MACRO_PARAM:  if (st->param < 0 || st->param >= fx->NumParameters) break;
+                         fx->Parameters[st->param] = st->val;
+                         // the macro's value replaces one still waiting to be sent from a pedal
+                         if (param_changes[current_input][st->slot][st->param].pending) {
+                           param_changes[current_input][st->slot][st->param].pending = false;
+                           param_changes_pending--;
+                         }
+                         break;
+    }
+  }
+
+  // and queue whatever is different from before
+  sent = 0;
+  for (slot = 0; slot < 7; slot++) {
+    if (strcmp(cur->effects[slot].EffectName, fx_new[slot].EffectName) != 0) {
+      spark_msg_out.change_effect_input(cur->effects[slot].EffectName, fx_new[slot].EffectName, current_input);
+      app_msg_out.change_effect_input(cur->effects[slot].EffectName, fx_new[slot].EffectName, current_input);
+      spark_queue();
+      app_queue();
+      model_change_settle();
+      sent++;
+    }
+  }
+  for (slot = 0; slot < 7; slot++) {
+    if (cur->effects[slot].OnOff != fx_new[slot].OnOff) {
+      spark_msg_out.turn_effect_onoff_input(fx_new[slot].EffectName, fx_new[slot].OnOff, current_input);
+      app_msg_out.turn_effect_onoff_input(fx_new[slot].EffectName, fx_new[slot].OnOff, current_input);
+      spark_queue();
+      app_queue();
+      sent++;
+    }
+  }
+  // a new model has all its parameters sent, as the amp starts it from its own values
+  for (slot = 0; slot < 7; slot++) {
+    new_model = strcmp(cur->effects[slot].EffectName, fx_new[slot].EffectName) != 0;
+    for (param = 0; param < fx_new[slot].NumParameters; param++) {
+      if (new_model || cur->effects[slot].Parameters[param] != fx_new[slot].Parameters[param]) {
+        spark_msg_out.change_effect_parameter_input(fx_new[slot].EffectName, param, fx_new[slot].Parameters[param], current_input);
+        app_msg_out.change_effect_parameter_input(fx_new[slot].EffectName, param, fx_new[slot].Parameters[param], current_input);
+        spark_queue();
+        app_queue();
+        sent++;
+      }
+    }
+  }
+  memcpy(cur->effects, fx_new, sizeof(fx_new));
+
+  macro_runs++;
+  macro_messages += sent;
+  DEB("Macro ");
+  DEB(macros[num].name);
+  DEB(" messages ");
+  DEBUG(sent);
+}
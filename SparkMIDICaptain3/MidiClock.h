@@ -0,0 +1,42 @@
+#ifndef MidiClock_h
+#define MidiClock_h
+
+// MIDI clock to tap tempo
+//
+// MIDI clock is 24 0xF8 ticks per beat. The tick interval is the time across the last CLOCK_WINDOW ticks
+// divided by the number of ticks, in fixed point - timing jitter on each tick only affects the two ends,
+// so it is spread over the whole window. A missing tick is filled in, and a doubled or badly timed one is
+// left out. The BPM, in tenths, is only sent to the amp as tap tempo when it has moved by CLOCK_BPM_CHANGE
+// from the tempo last sent, and then at most every CLOCK_SEND_INTERVAL ms, so a steady clock sends nothing.
+// Start (0xFA) starts a fresh estimate, Stop (0xFC) stops sending until a Start or Continue (0xFB).
+// A clock that never sends Start is still followed.
+
+#define CLOCK_PPQN 24
+#define CLOCK_WINDOW 96                   // ticks the interval is measured over - 4 beats
+#define CLOCK_INTERVAL_FRAC 8             // interval is in 1/256 us
+#define CLOCK_REJECT_PCT 30               // a tick this far from where it should be is ignored
+#define CLOCK_REJECT_RESET 6              // unless there are this many in a row, when it is taken as a new tempo
+#define CLOCK_TIMEOUT 250000              // us - a gap longer than this (10 BPM) starts again
+#define CLOCK_SETTLE_TICKS CLOCK_PPQN     // ticks needed after a start before a tempo is sent
+#define CLOCK_BPM_CHANGE 5                // tenths of a BPM that count as a real change
+#define CLOCK_SEND_INTERVAL 250           // ms between tap tempo messages
+
+bool clock_running;
+unsigned long clock_times[CLOCK_WINDOW + 1];   // micros() of the most recent ticks
+int clock_head;                           // where the next tick goes
+int clock_count;                          // ticks in clock_times, 0 for none
+uint32_t clock_interval;                  // tick interval, us << CLOCK_INTERVAL_FRAC, 0 for none
+int clock_ticks;                          // accepted since the estimate started
+int clock_reject_run;                     // ticks rejected in a row
+int clock_bpm_x10;                        // current estimate in tenths of a BPM, 0 for none
+int clock_sent_bpm_x10;                   // last sent to the amp
+unsigned long clock_sent_time;
+unsigned long clock_rejected;
+unsigned long clock_filled;
+unsigned long clock_sends;
+
+void midi_clock_reset();
+void midi_clock_message(uint8_t status, unsigned long arrival);
+void midi_clock_report();
+
+#endif
@@ -0,0 +1,111 @@
+#include "MidiClock.h"
+
+void midi_clock_reset() {
+  clock_running = true;                   // a clock that never sends Start is still followed
+  midi_clock_restart();
+  clock_bpm_x10 = 0;
+  clock_sent_bpm_x10 = 0;
+  clock_sent_time = 0;
+  clock_rejected = 0;
+  clock_filled = 0;
+  clock_sends = 0;
+}
+
+// start a fresh estimate from the next tick
+void midi_clock_restart() {
+  clock_head = 0;
+  clock_count = 0;
+  clock_interval = 0;
+  clock_ticks = 0;
+  clock_reject_run = 0;
+}
+
+void midi_clock_add(unsigned long t) {
+  clock_times[clock_head] = t;
+  clock_head = (clock_head + 1) % (CLOCK_WINDOW + 1);
+  if (clock_count < CLOCK_WINDOW + 1) clock_count++;
+  clock_ticks++;
+}
+
+void midi_clock_tick(unsigned long arrival) {
+  unsigned long last, oldest, gap;
+  uint32_t x, periods, error;
+  int bpm_x10;
+
+  last = clock_times[(clock_head + CLOCK_WINDOW) % (CLOCK_WINDOW + 1)];
+  gap = arrival - last;
+  if (clock_count == 0 || gap > CLOCK_TIMEOUT) {
+    // first tick, or the clock went away for a while - nothing to measure from
+    midi_clock_restart();
+    midi_clock_add(arrival);
+    return;
+  }
+
+  if (clock_interval != 0) {
+    // how many tick intervals since the last one - 2 means one went missing, 0 means this is an extra one
+    x = gap << CLOCK_INTERVAL_FRAC;
+    periods = (x + clock_interval / 2) / clock_interval;
+    error = (x > periods * clock_interval) ? x - periods * clock_interval : periods * clock_interval - x;
+    if (periods == 0 || periods > 2 || error > clock_interval / 100 * CLOCK_REJECT_PCT) {
+      clock_rejected++;
+      if (++clock_reject_run < CLOCK_REJECT_RESET) return;
+      // a run of them means the tempo has jumped, so start again from here
+      midi_clock_restart();
+      midi_clock_add(arrival);
+      return;
+    }
+    if (periods == 2) {
+      midi_clock_add(arrival - gap / 2);
+      clock_filled++;
+    }
+  }
+  clock_reject_run = 0;
+  midi_clock_add(arrival);
+
+  oldest = clock_times[(clock_head + CLOCK_WINDOW + 1 - clock_count) % (CLOCK_WINDOW + 1)];
+  clock_interval = ((uint64_t) (arrival - oldest) << CLOCK_INTERVAL_FRAC) / (clock_count - 1);
+
+  // BPM = 60,000,000 / (interval * 24), in tenths and rounded
+  bpm_x10 = ((600000000ULL << CLOCK_INTERVAL_FRAC) / CLOCK_PPQN + clock_interval / 2) / clock_interval;
+  clock_bpm_x10 = bpm_x10;
+
+  if (!clock_running || clock_ticks < CLOCK_SETTLE_TICKS) return;
+  if (abs(bpm_x10 - clock_sent_bpm_x10) < CLOCK_BPM_CHANGE) return;
+  if (clock_sends > 0 && millis() - clock_sent_time < CLOCK_SEND_INTERVAL) return;
+
+  clock_sent_bpm_x10 = bpm_x10;
+  clock_sent_time = millis();
+  clock_sends++;
+  send_tap_tempo(bpm_x10 / 10.0);
+  DEB("Clock tempo ");
+  DEBUG(bpm_x10 / 10.0);
+}
+// realtime messages from the MIDI event queue, with the time their byte arrived
+void midi_clock_message(uint8_t status, unsigned long arrival) {
+  switch (status) {
+    case 0xF8: midi_clock_tick(arrival);
+               break;
+    case 0xFA: midi_clock_restart();
+               clock_running = true;
+               break;
+    case 0xFB: clock_running = true;
+               break;
+    case 0xFC: clock_running = false;
+               break;
+  }
+}
+
+void midi_clock_report() {
+  Serial.print("MIDI clock: ");
+  Serial.print(clock_running ? "running" : "stopped");
+  Serial.print("  BPM: ");
+  Serial.print(clock_bpm_x10 / 10.0, 1);
+  Serial.print("  last sent: ");
+  Serial.print(clock_sent_bpm_x10 / 10.0, 1);
+  Serial.print("  sends: ");
+  Serial.print(clock_sends);
+  Serial.print("  ticks rejected: ");
+  Serial.print(clock_rejected);
+  Serial.print("  filled in: ");
+  Serial.println(clock_filled);
+}
@@ -0,0 +1,81 @@
+#ifndef MidiMap_h
+#define MidiMap_h
+
+// MIDI mapping table
+//
+// Each message is looked up in midi_map[type][channel][data1] to give the action to carry out - one array
+// index instead of a chain of cases, and the mapping can be changed without reflashing.
+// Profile 0 is the built in mapping, compiled from tools/map_builtin.txt into MidiMapBuiltin.h by
+// tools/mapc.py - so it is checked at build time and needs no parsing at start up.
+// Profiles 1 to MIDI_MAP_PROFILES - 1 are text files /map<n>.txt on LittleFS, one mapping per line:
+//
+//   # comment
+//   <type> <channel> <data1> <action> [<curve>]
+//
+// type is note_off, note_on, cc or pc; channel is 1-16 or * for all; data1 is 0-127 or * for all (the
+// program number for pc); action is one of midi_action_names[]. A later line overrides an earlier one.
+// A cc can have a curve for the value passed to its action - lin, log, exp or inv, optionally followed by
+// the range it covers, eg log:0.2-0.8 (or 0.8-0.2 to turn it round). Each different curve is worked out
+// into a 128 entry table when the profile is loaded, so the value is just a lookup. A later line for a cc
+// replaces its curve too, so one with no curve puts it back to lin 0-1.
+// A profile is loaded into the spare table and only swapped in once the whole file has been read, so a bad
+// file leaves the current mapping as it was.
+
+#include <LittleFS.h>
+
+#define MIDI_MAP_PROFILES 4
+#define MIDI_MAP_LINE_MAX 64
+#define MIDI_MAP_CURVES 16                // different curves in a profile, 0 is always lin 0-1
+
+enum midi_map_type_t {MAP_NOTE_OFF, MAP_NOTE_ON, MAP_CC, MAP_PC, MAP_TYPES};
+const char *midi_map_type_names[] {"note_off", "note_on", "cc", "pc"};
+
+// status >> 4 to table, -1 for messages that aren't mapped
+const int8_t midi_map_type_of[16] {-1, -1, -1, -1, -1, -1, -1, -1, 
+                                   MAP_NOTE_OFF, MAP_NOTE_ON, -1, MAP_CC, MAP_PC, -1, -1, -1};
+
+enum midi_action_t {ACT_NONE, ACT_GAIN, ACT_MASTER, 
+                    ACT_NOISEGATE, ACT_COMP, ACT_DRIVE, ACT_MOD, ACT_DELAY, ACT_REVERB,
+                    ACT_PRESET_UP, ACT_PRESET_DOWN, ACT_AMP_NEXT, ACT_MOD_NEXT, ACT_PROFILE_NEXT,
+                    ACT_MACRO_1, ACT_MACRO_2, ACT_MACRO_3, ACT_MACRO_4, ACT_SETLIST_NEXT, ACT_SETLIST_PREV,
+                    ACT_COUNT};
+const char *midi_action_names[] {"none", "gain", "master", 
+                                 "noisegate", "comp", "drive", "mod", "delay", "reverb",
+                                 "preset_up", "preset_down", "amp_next", "mod_next", "profile_next",
+                                 "macro1", "macro2", "macro3", "macro4", "setlist_next", "setlist_prev"};
+
+enum midi_curve_shape_t {CURVE_LIN, CURVE_LOG, CURVE_EXP, CURVE_INV, CURVE_SHAPES};
+const char *midi_curve_names[] {"lin", "log", "exp", "inv"};
+
+struct midi_curve_spec {
+  uint8_t shape;
+  float lo, hi;                           // value for 0 and 127
+};
+
+struct midi_map_t {
+  uint8_t action[MAP_TYPES][16][128];
+  uint8_t cc_curve[16][128];              // which of curve[] each cc uses
+  float curve[MIDI_MAP_CURVES][128];
+  midi_curve_spec spec[MIDI_MAP_CURVES];
+  int num_curves;
+};
+
+// the curve of a cc in the built in mapping, chan -1 for all - curve is the index in midi_map_t.curve[]
+struct midi_curve_use {
+  int8_t chan;
+  uint8_t data1;
+  uint8_t curve;
+};
+
+#include "MidiMapBuiltin.h"
+
+midi_map_t midi_map_tables[2];
+midi_map_t *midi_map = &midi_map_tables[0];       // the one in use, the other is for loading
+int midi_map_profile;
+
+void setup_midi_map();
+int midi_map_lookup(uint8_t *mi, float *val);
+bool midi_map_select(int profile);
+void midi_map_report();
+
+#endif
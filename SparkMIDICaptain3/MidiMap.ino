@@ -0,0 +1,229 @@
+#include "MidiMap.h"
+
+// action for a message, ACT_NONE if it isn't mapped, and the second data byte through its curve
+int midi_map_lookup(uint8_t *mi, float *val) {
+  int type = midi_map_type_of[mi[0] >> 4];
+  int chan = mi[0] & 0x0f;
+
+  if (type < 0) return ACT_NONE;
+  *val = midi_map->curve[type == MAP_CC ? midi_map->cc_curve[chan][mi[1]] : 0][mi[2]];
+  return midi_map->action[type][chan][mi[1]];
+}
+
+float midi_curve_value(int shape, float x) {
+  switch (shape) {
+    case CURVE_LOG: return log10f(1.0 + 9.0 * x);
+    case CURVE_EXP: return (powf(10.0, x) - 1.0) / 9.0;
+    case CURVE_INV: return 1.0 - x;
+    default:        return x;
+  }
+}
+
+// index of a curve in the map, working it out if it is new - -1 if there is no room
+int midi_map_curve(midi_map_t *map, int shape, float lo, float hi) {
+  midi_curve_spec *sp;
+  int i, v;
+
+  for (i = 0; i < map->num_curves; i++) {
+    sp = &map->spec[i];
+    if (sp->shape == shape && sp->lo == lo && sp->hi == hi) return i;
+  }
+  if (i == MIDI_MAP_CURVES) return -1;
+  map->spec[i] = {(uint8_t) shape, lo, hi};
+  for (v = 0; v < 128; v++)
+    map->curve[i][v] = lo + (hi - lo) * midi_curve_value(shape, v / 127.0);
+  map->num_curves++;
+  return i;
+}
+
+// nothing mapped, and only the lin 0-1 curve
+void midi_map_clear(midi_map_t *map) {
+  memset(map, 0, sizeof(midi_map_t));
+  midi_map_curve(map, CURVE_LIN, 0.0, 1.0);
+}
+
+// set a mapping for one channel, or all of them if chan is -1
+void midi_map_set(midi_map_t *map, int type, int chan, int data1, int action, int curve) {
+  for (int c = 0; c < 16; c++)
+    if (chan < 0 || c == chan) {
+      map->action[type][c][data1] = action;
+      if (type == MAP_CC) map->cc_curve[c][data1] = curve;
+    }
+}
+
+static_assert(MIDI_MAP_BUILTIN_SPECS < MIDI_MAP_CURVES, "too many curves in the built in mapping");
+
+// the built in mapping, from the rows and curves compiled by tools/mapc.py - the same table
+// midi_map_load() makes from the mapping file
+void midi_map_default(midi_map_t *map) {
+  const midi_curve_spec *sp;
+  const midi_curve_use *cu;
+
+  midi_map_clear(map);
+  // in the order midi_map_parse_line() met them, so each curve has the same index
+  for (int i = 0; i < MIDI_MAP_BUILTIN_SPECS; i++) {
+    sp = &midi_map_builtin_specs[i];
+    midi_map_curve(map, sp->shape, sp->lo, sp->hi);
+  }
+  for (int type = 0; type < MAP_TYPES; type++)
+    for (int c = 0; c < 16; c++)
+      memcpy(map->action[type][c], midi_map_builtin_rows[midi_map_builtin_index[type][c]], 128);
+
+  // the curve each cc was left with by the last line for it
+  for (int i = 0; i < MIDI_MAP_BUILTIN_CURVES; i++) {
+    cu = &midi_map_builtin_curves[i];
+    for (int c = 0; c < 16; c++)
+      if (cu->chan < 0 || c == cu->chan) 
+        map->cc_curve[c][cu->data1] = cu->curve;
+  }
+}
+
+int midi_map_find(const char *name, const char **names, int count) {
+  for (int i = 0; i < count; i++)
+    if (strcmp(name, names[i]) == 0) return i;
+  return -1;
+}
+
+// a whole number from lo to hi, as tools/mapc.py takes it - false for anything else, like 'x' or '20x'
+bool midi_map_number(const char *s, int lo, int hi, int *n) {
+  char *end;
+  long v;
+
+  v = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || v < lo || v > hi) return false;
+  *n = v;
+  return true;
+}
+
+// one line of a profile file, false if it doesn't make sense
+bool midi_map_parse_line(midi_map_t *map, char *line) {
+  char *type_s, *chan_s, *data_s, *act_s, *curve_s, *range_s, *end;
+  int type, chan, data1, action, shape, curve;
+  float lo, hi;
+
+  type_s = strtok(line, " \t\r\n");
+  if (type_s == NULL || type_s[0] == '#') return true;        // blank or comment
+  chan_s = strtok(NULL, " \t\r\n");
+  data_s = strtok(NULL, " \t\r\n");
+  act_s  = strtok(NULL, " \t\r\n");
+  curve_s = strtok(NULL, " \t\r\n");
+  if (act_s == NULL) return false;
+
+  type = midi_map_find(type_s, midi_map_type_names, MAP_TYPES);
+  action = midi_map_find(act_s, midi_action_names, ACT_COUNT);
+  if (type < 0 || action < 0) return false;
+  if (strcmp(chan_s, "*") == 0) 
+    chan = -1;
+  else if (midi_map_number(chan_s, 1, 16, &chan)) 
+    chan--;
+  else 
+    return false;
+
+  // <shape>[:<lo>-<hi>]
+  curve = 0;
+  if (curve_s != NULL && curve_s[0] != '#') {
+    if (type != MAP_CC) return false;
+    lo = 0.0;
+    hi = 1.0;
+    range_s = strchr(curve_s, ':');
+    if (range_s != NULL) {
+      *range_s++ = '\0';
+      lo = strtof(range_s, &end);
+      if (end == range_s || *end != '-') return false;
+      range_s = end + 1;
+      hi = strtof(range_s, &end);
+      if (end == range_s || *end != '\0') return false;
+      if (lo < 0.0 || lo > 1.0 || hi < 0.0 || hi > 1.0) return false;
+    }
+    shape = midi_map_find(curve_s, midi_curve_names, CURVE_SHAPES);
+    if (shape < 0) return false;
+    curve = midi_map_curve(map, shape, lo, hi);
+    if (curve < 0) return false;
+  }
+
+  if (strcmp(data_s, "*") == 0) {
+    for (data1 = 0; data1 < 128; data1++)
+      midi_map_set(map, type, chan, data1, action, curve);
+    return true;
+  }
+  if (!midi_map_number(data_s, 0, 127, &data1)) return false;
+  midi_map_set(map, type, chan, data1, action, curve);
+  return true;
+}
+
+// read /map<n>.txt into a table
+bool midi_map_load(midi_map_t *map, int profile) {
+  char path[16], line[MIDI_MAP_LINE_MAX + 1];
+  int len, line_num;
+  File f;
+
+  sprintf(path, "/map%d.txt", profile);
+  f = LittleFS.open(path, "r");
+  if (!f) {
+    DEB("No mapping file ");
+    DEBUG(path);
+    return false;
+  }
+  midi_map_clear(map);
+  line_num = 0;
+  while (f.available()) {
+    len = f.readBytesUntil('\n', line, MIDI_MAP_LINE_MAX);
+    line[len] = '\0';
+    if (len == MIDI_MAP_LINE_MAX)                 // only long comments, so drop the rest
+      while (f.available() && f.read() != '\n');
+    line_num++;
+    if (!midi_map_parse_line(map, line)) {
+      DEB("Bad mapping in ");
+      DEB(path);
+      DEB(" line ");
+      DEBUG(line_num);
+      f.close();
+      return false;
+    }
+  }
+  f.close();
+  return true;
+}
+
+// load a profile into the spare table and swap it in, or keep the current one if it won't load
+bool midi_map_select(int profile) {
+  midi_map_t *spare;
+
+  if (profile < 0 || profile >= MIDI_MAP_PROFILES) return false;
+  spare = (midi_map == &midi_map_tables[0]) ? &midi_map_tables[1] : &midi_map_tables[0];
+  if (profile == 0) 
+    midi_map_default(spare);
+  else if (!midi_map_load(spare, profile)) 
+    return false;
+  midi_map = spare;
+  midi_map_profile = profile;
+  DEB("Mapping profile ");
+  DEBUG(profile);
+  return true;
+}
+
+void setup_midi_map() {
+  midi_map_default(midi_map);
+  midi_map_profile = 0;
+  if (!LittleFS.begin(false)) 
+    DEBUG("LittleFS not mounted - only the built in mapping");
+}
+
+void midi_map_report() {
+  int type, chan, data1, count;
+
+  Serial.print("Mapping profile ");
+  Serial.println(midi_map_profile);
+  for (type = 0; type < MAP_TYPES; type++) {
+    count = 0;
+    for (chan = 0; chan < 16; chan++)
+      for (data1 = 0; data1 < 128; data1++)
+        if (midi_map->action[type][chan][data1] != ACT_NONE) count++;
+    Serial.print("  ");
+    Serial.print(midi_map_type_names[type]);
+    Serial.print(": ");
+    Serial.println(count);
+  }
+  Serial.print("  curves: ");
+  Serial.println(midi_map->num_curves);
+}
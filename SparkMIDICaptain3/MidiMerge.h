@@ -0,0 +1,43 @@
+#ifndef MidiMerge_h
+#define MidiMerge_h
+
+// Merge of the MIDI sources
+//
+// The same controller can be connected more than one way at once - a MIDI Captain over USB and DIN, or a
+// BLE pedal as well - and each press must only act once. Every event from the queue goes through
+// midi_merge_accept() before it is acted on, which remembers what it let through over the last
+// merge_window_us for each control (status and first data byte, or just status for a program change).
+// Within that window, for another source:
+//   the same message is a duplicate and is dropped
+//   a different value is only taken if the source's priority is at least that of the one already taken
+// A source can always repeat itself, and a source with priority 0 is ignored completely.
+// MIDI clock is taken from one source only - the highest priority one that has sent clock recently.
+
+#define MERGE_WINDOW_MS 30                // default - longer than a BLE connection interval
+#define MERGE_RECENT 16                   // controls remembered, the oldest is reused
+#define MERGE_CLOCK_TIMEOUT 500000        // us without clock before another source can take over
+
+// higher wins, 0 to ignore the source - same order as midi_source_t
+int merge_priority[MIDI_SRC_COUNT] {2, 3, 3, 1};
+
+struct merge_entry {
+  uint8_t msg[3];
+  uint8_t source;
+  unsigned long arrival;
+};
+
+merge_entry merge_recent[MERGE_RECENT];
+int merge_next;                           // entry to reuse next
+unsigned long merge_window_us = MERGE_WINDOW_MS * 1000UL;
+
+int merge_clock_source = -1;              // -1 for none yet
+unsigned long merge_clock_time;
+
+unsigned long merge_duplicates;
+unsigned long merge_overruled;
+unsigned long merge_ignored;
+
+bool midi_merge_accept(struct midi_event *ev);
+void midi_merge_report();
+
+#endif
@@ -0,0 +1,87 @@
+#include "MidiMerge.h"
+
+// the first data byte is part of the control for everything but program change and channel pressure
+bool merge_same_control(uint8_t *a, uint8_t *b) {
+  if (a[0] != b[0]) return false;
+  if ((a[0] & 0xE0) == 0xC0) return true;
+  return a[1] == b[1];
+}
+
+// realtime messages - only follow one clock
+bool merge_clock(struct midi_event *ev) {
+  unsigned long now = ev->arrival;
+
+  if (merge_clock_source < 0 || 
+      merge_clock_source == ev->source ||
+      (long) (now - merge_clock_time) > (long) MERGE_CLOCK_TIMEOUT ||
+      merge_priority[ev->source] > merge_priority[merge_clock_source]) {
+    if (merge_clock_source != ev->source && merge_clock_source >= 0) midi_clock_restart();
+    merge_clock_source = ev->source;
+    merge_clock_time = now;
+    return true;
+  }
+  merge_duplicates++;
+  return false;
+}
+
+// false if the event has already been acted on from another source, or lost to a higher priority one
+bool midi_merge_accept(struct midi_event *ev) {
+  merge_entry *e;
+  int i;
+
+  if (merge_priority[ev->source] == 0) {
+    merge_ignored++;
+    return false;
+  }
+  if (ev->msg[0] >= 0xF8) return merge_clock(ev);
+
+  for (i = 0; i < MERGE_RECENT; i++) {
+    e = &merge_recent[i];
+    if (e->msg[0] == 0 || !merge_same_control(e->msg, ev->msg)) continue;
+    // signed - a source can stamp an event a little before one already taken from another
+    if (labs((long) (ev->arrival - e->arrival)) > merge_window_us) break;   // too far apart, so take this one
+    if (e->source == ev->source) break;
+    if (memcmp(e->msg, ev->msg, 3) == 0) {
+      merge_duplicates++;
+      return false;
+    }
+    if (merge_priority[ev->source] < merge_priority[e->source]) {
+      merge_overruled++;
+      return false;
+    }
+    break;
+  }
+  // remember it, in the entry for the same control if there is one
+  if (i == MERGE_RECENT) {
+    i = merge_next;
+    merge_next = (merge_next + 1) % MERGE_RECENT;
+  }
+  e = &merge_recent[i];
+  memcpy(e->msg, ev->msg, 3);
+  e->source = ev->source;
+  e->arrival = ev->arrival;
+  return true;
+}
+
+void midi_merge_report() {
+  int s;
+
+  Serial.print("Merge window: ");
+  Serial.print(merge_window_us / 1000);
+  Serial.print(" ms  duplicates: ");
+  Serial.print(merge_duplicates);
+  Serial.print("  overruled: ");
+  Serial.print(merge_overruled);
+  Serial.print("  ignored: ");
+  Serial.println(merge_ignored);
+  for (s = 0; s < MIDI_SRC_COUNT; s++) {
+    Serial.print("  ");
+    Serial.print(midi_source_names[s]);
+    Serial.print(" priority ");
+    Serial.println(merge_priority[s]);
+  }
+  if (merge_clock_source >= 0) {
+    Serial.print("  clock from ");
+    Serial.println(midi_source_names[merge_clock_source]);
+  }
+}
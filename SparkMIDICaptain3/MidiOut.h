@@ -0,0 +1,37 @@
+#ifndef MidiOut_h
+#define MidiOut_h
+
+// MIDI output - LED feedback to the controller
+//
+// update_midi_feedback() compares the effect on/off states and the preset number with what each output was
+// last sent, and sends a CC or Program Change for anything that has changed - whether it was changed by our
+// own MIDI, the app or the amp. USB gets them as one bulk transfer of 4 byte USB-MIDI event packets, DIN as
+// one write to the TX pin. The messages are built at the moment they are sent, and an output only records
+// what it has been sent once the send has worked - so if the USB transfer is still busy, USB gets the latest
+// state next time round, and DIN doesn't wait for it.
+
+#define MIDI_OUT_MAX 16                   // USB-MIDI event packets in one bulk transfer - 64 bytes
+#define MIDI_FEEDBACK_CHANNEL 0           // 0 to 15
+
+enum {MIDI_OUT_USB, MIDI_OUT_DIN, MIDI_OUT_ALL};
+
+// CC sent for each effect slot, -1 for none - the same CCs that toggle them
+const int feedback_cc[] {20, 21, 22, -1, 23, 80, 81};
+
+uint8_t midi_out_buf[MIDI_OUT_MAX * 4];
+int midi_out_count;
+unsigned long midi_out_transfers;
+unsigned long midi_out_dropped;
+unsigned long midi_out_busy;              // USB sends put off because the last transfer hadn't finished
+
+// what each output was last told, -1 if nothing yet
+int feedback_onoff[MIDI_OUT_ALL][7];
+int feedback_preset[MIDI_OUT_ALL];
+
+void midi_out_cc(int chan, int cc, int val);
+void midi_out_pc(int chan, int prog);
+bool flush_midi_out(int out);
+void update_midi_feedback();
+void midi_feedback_resend(int out);
+
+#endif
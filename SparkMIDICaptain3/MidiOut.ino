@@ -0,0 +1,105 @@
+#include "MidiOut.h"
+
+// add a USB-MIDI event packet - the CIN for channel messages is the top nibble of the status
+void midi_out_add(uint8_t status, uint8_t data1, uint8_t data2) {
+  uint8_t *p;
+
+  if (midi_out_count >= MIDI_OUT_MAX) {
+    midi_out_dropped++;
+    return;
+  }
+  p = &midi_out_buf[midi_out_count * 4];
+  p[0] = status >> 4;                     // cable 0
+  p[1] = status;
+  p[2] = data1;
+  p[3] = data2;
+  midi_out_count++;
+}
+
+void midi_out_cc(int chan, int cc, int val) {
+  midi_out_add(0xB0 | (chan & 0x0f), cc & 0x7f, val & 0x7f);
+}
+
+void midi_out_pc(int chan, int prog) {
+  midi_out_add(0xC0 | (chan & 0x0f), prog & 0x7f, 0);
+}
+
+// send what has been built to one output - false if it can't go now
+bool flush_midi_out(int out) {
+  uint8_t din[MIDI_OUT_MAX * 3];
+  int din_len, len, i;
+
+  if (midi_out_count == 0) return true;
+
+  if (out == MIDI_OUT_USB) {
+#ifdef USB_S3
+    // the previous transfer is still going - try again next time round
+    if (!usb_midi_send(midi_out_buf, midi_out_count * 4)) {
+      midi_out_busy++;
+      return false;
+    }
+#endif
+#ifdef USB_HOST
+    if (!usb_connected || !Midi) return false;
+    Midi.SendRawData(midi_out_count * 4, midi_out_buf);
+#endif
+  }
+  else {
+    // DIN has no packet framing, so just the MIDI bytes
+    din_len = 0;
+    for (i = 0; i < midi_out_count; i++) {
+      len = ((midi_out_buf[i * 4 + 1] & 0xE0) == 0xC0) ? 2 : 3;     // program change and channel pressure are 2 bytes
+      memcpy(&din[din_len], &midi_out_buf[i * 4 + 1], len);
+      din_len += len;
+    }
+    if (!din_midi_send(din, din_len)) return false;
+  }
+
+  midi_out_transfers++;
+  return true;
+}
+
+// make the next update_midi_feedback() send everything again to one output, or both
+void midi_feedback_resend(int out) {
+  int o, i;
+
+  for (o = 0; o < MIDI_OUT_ALL; o++) {
+    if (out != MIDI_OUT_ALL && out != o) continue;
+    for (i = 0; i < 7; i++)
+      feedback_onoff[o][i] = -1;
+    feedback_preset[o] = -1;
+  }
+}
+
+// build the messages for whatever this output hasn't been told, send them, and only then record them as sent
+void midi_feedback_send(int out, int *onoff, int preset) {
+  unsigned long dropped;
+  int i;
+
+  midi_out_count = 0;
+  dropped = midi_out_dropped;
+  if (preset != feedback_preset[out]) 
+    midi_out_pc(MIDI_FEEDBACK_CHANNEL, preset);
+  for (i = 0; i < 7; i++)
+    if (feedback_cc[i] >= 0 && onoff[i] != feedback_onoff[out][i]) 
+      midi_out_cc(MIDI_FEEDBACK_CHANNEL, feedback_cc[i], onoff[i] ? 127 : 0);
+
+  if (midi_out_count == 0 || midi_out_dropped != dropped || !flush_midi_out(out)) return;
+  feedback_preset[out] = preset;
+  memcpy(feedback_onoff[out], onoff, sizeof(feedback_onoff[out]));
+  midi_out_count = 0;
+}
+
+// send feedback for any effect or preset that has changed since each output was last told
+void update_midi_feedback() {
+  int onoff[7], i;
+
+  if (spark_state != SPARK_SYNCED) return;
+
+  for (i = 0; i < 7; i++)
+    onoff[i] = presets[CUR_EDITING][current_input].effects[i].OnOff ? 1 : 0;
+#if defined USB_S3 || defined USB_HOST
+  midi_feedback_send(MIDI_OUT_USB, onoff, display_preset_num);
+#endif
+  midi_feedback_send(MIDI_OUT_DIN, onoff, display_preset_num);
+}
@@ -0,0 +1,61 @@
+#ifndef ModelCatalog_h
+#define ModelCatalog_h
+
+// Generated by tools/gen_catalog.py from spark_models.txt and SparkPresets.h - edit those and run it again, not this
+
+#define MODEL_COUNT 47
+
+const spark_model model_catalog[MODEL_COUNT] {
+  {"bias.noisegate",    0, 3, {0.138313, 0.224643, 0.000000}},
+  {"LA2AComp",          1, 3, {0.000000, 0.852394, 0.373072}},
+  {"BlueComp",          1, 4, {0.430518, 0.663291, 0.355048, 0.557014}},
+  {"Compressor",        1, 2, {0.325460, 0.789062}},
+  {"BassComp",          1, 2, {0.372727, 0.530303}},
+  {"BBEOpticalComp",    1, 3, {0.712698, 0.370691, 0.000000}},
+  {"Booster",           2, 1, {0.722592}},
+  {"DistortionTS9",     2, 3, {0.058011, 0.741722, 0.595924}},
+  {"Overdrive",         2, 3, {0.586207, 0.500288, 0.530172}},
+  {"Fuzz",              2, 2, {0.436505, 1.000000}},
+  {"GuitarMuff",        2, 3, {0.619421, 0.692053, 0.805691}},
+  {"MaestroBassmaster", 2, 3, {0.698052, 0.276184, 0.566086}},
+  {"SABdriver",         2, 4, {0.535256, 1.000000, 0.724359, 1.000000}},
+  {"RolandJC120",       3, 5, {0.632231, 0.281820, 0.158359, 0.671320, 0.805785}},
+  {"Twin",              3, 5, {0.613433, 0.371715, 0.453167, 0.676660, 0.805785}},
+  {"ADClean",           3, 5, {0.677083, 0.501099, 0.382828, 0.585946, 0.812231}},
+  {"94MatchDCV2",       3, 5, {0.528926, 0.500905, 0.246163, 0.417119, 0.782293}},
+  {"Bassman",           3, 5, {0.768152, 0.491509, 0.476547, 0.284314, 0.389779}},
+  {"AC Boost",          3, 5, {0.707792, 0.591124, 0.383605, 0.532821, 0.195119}},
+  {"TwoStoneSP50",      3, 5, {0.634593, 0.507692, 0.664699, 0.519608, 0.714050}},
+  {"Bogner",            3, 5, {0.655844, 0.626593, 0.640734, 0.351588, 0.338571}},
+  {"OrangeAD30",        3, 5, {0.620474, 0.312894, 0.484227, 0.527442, 0.492836}},
+  {"AmericanHighGain",  3, 5, {0.616274, 0.431090, 0.419846, 0.495112, 0.850637}},
+  {"SLO100",            3, 5, {0.590909, 0.512066, 0.583825, 0.287179, 0.507674}},
+  {"YJM100",            3, 5, {0.562574, 0.485294, 0.317001, 0.250528, 0.576942}},
+  {"Rectifier",         3, 5, {0.706630, 0.425070, 0.450462, 0.498249, 0.795350}},
+  {"EVH",               3, 5, {0.599518, 0.467647, 0.407468, 0.357744, 0.820512}},
+  {"SwitchAxeLead",     3, 5, {0.572609, 0.352941, 0.374004, 0.460784, 0.705431}},
+  {"BE101",             3, 5, {0.587958, 0.343137, 0.475797, 0.394193, 0.875443}},
+  {"Acoustic",          3, 5, {0.639823, 0.385056, 0.383449, 0.599397, 0.519480}},
+  {"FatAcousticV2",     3, 5, {0.453955, 0.292760, 0.565172, 0.575339, 0.829431}},
+  {"GK800",             3, 5, {0.688351, 0.407152, 0.399197, 0.746875, 0.774234}},
+  {"W600",              3, 5, {0.664699, 0.423077, 0.276884, 0.415083, 0.448052}},
+  {"Tremolo",           4, 3, {0.454134, 0.699934, 0.596154}},
+  {"ChorusAnalog",      4, 4, {0.185431, 0.086409, 0.485027, 0.567797}},
+  {"Flanger",           4, 3, {0.413793, 0.663043, 0.655172}},
+  {"Phaser",            4, 2, {0.331250, 0.620000}},
+  {"UniVibe",           4, 3, {0.500000, 1.000000, 0.700000}},
+  {"Cloner",            4, 2, {0.199593, 0.000000}},
+  {"MiniVibe",          4, 2, {0.047057, 0.117188}},
+  {"Tremolator",        4, 3, {0.330000, 0.500000, 1.000000}},
+  {"DelayMono",         5, 5, {0.173729, 0.233051, 0.493579, 0.600000, 1.000000}},
+  {"DelayEchoFilt",     5, 5, {0.533909, 0.275554, 0.455372, 0.457702, 1.000000}},
+  {"VintageDelay",      5, 4, {0.378739, 0.425745, 0.419816, 1.000000}},
+  {"DelayMultiHead",    5, 5, {0.706667, 0.644172, 0.564417, 0.650000, 1.000000}},
+  {"DelayRe201",        5, 5, {0.097778, 0.312182, 0.485182, 0.369640, 1.000000}},
+  {"bias.reverb",       6, 7, {0.285714, 0.408354, 0.289489, 0.388317, 0.582143, 0.650000, 0.200000}},
+};
+
+// first entry for each slot - slot n is model_slot_start[n] up to model_slot_start[n + 1]
+const int model_slot_start[8] {0, 1, 6, 13, 33, 41, 46, 47};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef Models_h
+#define Models_h
+
+// Model catalog
+//
+// Every model in the protocol description's list (tools/spark_models.txt) that a preset in SparkPresets.h
+// uses, with its slot (0 noisegate to 6 reverb), how many parameters it has and values for them. The slots
+// come from the protocol description, the counts and values from the presets, as the description has none.
+// ModelCatalog.h is generated by tools/gen_catalog.py - run it again when presets are added. amp_next and
+// mod_next step through one slot's models from the one in use now. A model change keeps the values the user
+// had, like the app does for an amp, and only takes the catalog's for parameters the old model didn't have -
+// then sends all of them, as the amp starts a new model from its own. NumParameters always follows the model
+// in a slot, so a parameter index the model doesn't have is never sent. When the amp or app changes to a model
+// that isn't in the catalog it is 0, so nothing is sent for that slot, until a preset from the amp gives the
+// real count.
+
+struct spark_model {
+  const char *name;
+  int slot;
+  int num_params;
+  float defaults[10];
+};
+
+#include "ModelCatalog.h"
+
+const spark_model *model_find(const char *name);
+const spark_model *model_next(int slot, const char *name);
+void model_set(SparkPreset::SparkEffects *fx, const spark_model *m);
+void change_model(const spark_model *m, bool app);
+
+#endif
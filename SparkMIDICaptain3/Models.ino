@@ -0,0 +1,39 @@
+#include "Models.h"
+
+const spark_model *model_find(const char *name) {
+  int i;
+
+  for (i = 0; i < MODEL_COUNT; i++)
+    if (strcmp(model_catalog[i].name, name) == 0) return &model_catalog[i];
+  return NULL;
+}
+
+// the model after this one in the slot, going back to the first after the last
+// or the first one if this isn't a model for the slot
+const spark_model *model_next(int slot, const char *name) {
+  const spark_model *m;
+  int i;
+
+  if (slot < 0 || slot > 6 || model_slot_start[slot] == model_slot_start[slot + 1]) return NULL;
+  m = model_find(name);
+  if (m == NULL || m->slot != slot) return &model_catalog[model_slot_start[slot]];
+  i = m - model_catalog + 1;
+  if (i >= model_slot_start[slot + 1]) i = model_slot_start[slot];
+  return &model_catalog[i];
+}
+
+// make the effect this model, with the catalog's parameter count
+// the parameters the old model had keep their values - the catalog's are only for the ones it didn't have
+void model_set(SparkPreset::SparkEffects *fx, const spark_model *m) {
+  int param;
+
+  for (param = 0; param < 10; param++) {
+    if (param >= m->num_params) 
+      fx->Parameters[param] = 0.0;
+    else if (param >= fx->NumParameters) 
+      fx->Parameters[param] = m->defaults[param];
+  }
+  strncpy(fx->EffectName, m->name, STR_LEN - 1);
+  fx->EffectName[STR_LEN - 1] = '\0';
+  fx->NumParameters = m->num_params;
+}
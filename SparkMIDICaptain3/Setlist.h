@@ -0,0 +1,44 @@
+#ifndef Setlist_h
+#define Setlist_h
+
+// Setlist of custom presets
+//
+// The amp's temporary slot (0x7f) is kept loaded with the next preset in the setlist, uploaded in the background
+// by update_spark_upload() while the current one is played. Moving on to it is then just a change to preset
+// 0x7f - one small message - instead of the whole preset going over at the moment of switching.
+// Moving to a preset that isn't loaded (going back, or pressing again before the upload has finished) uploads
+// it first and switches when the amp has acknowledged all of it. An upload that has started is always let
+// finish - the amp has no way to drop half a multi-chunk 0x0101 - so a different preset waits for it.
+//
+// This assumes how the amp behaves - it isn't in the protocol description and hasn't been checked on an amp: a change to
+// 0x7f copies the slot into the amp's current settings, and the amp's 0x0438 ack comes after that copy. After
+// the ack the slot can be overwritten without changing the sound, so the next preload waits for the 0x0438,
+// or SETLIST_SELECT_TIMEOUT if it never comes.
+
+// positions in my_presets[] from SparkPresets.h
+const int setlist[] {0, 3, 8, 12, 7};
+const int setlist_len = sizeof(setlist) / sizeof(int);
+
+int setlist_pos = -1;                     // -1 before the first song
+int setlist_loaded = -1;                  // setlist position the temporary slot holds, -1 if not known
+int setlist_loading = -1;                 // position being uploaded, -1 for none
+bool setlist_switch_pending;              // switch to setlist_pos once it is loaded
+bool setlist_selecting;                   // the change to 0x7f hasn't been acked yet
+unsigned long setlist_select_time;
+unsigned long setlist_press_time;
+
+unsigned long setlist_switches;
+unsigned long setlist_prefetched;         // switches that only needed the preset change
+unsigned long setlist_last_switch_us;
+unsigned long setlist_select_timeouts;
+
+#define SETLIST_SELECT_TIMEOUT 400        // ms
+
+void setlist_go(int pos);
+void update_setlist();
+void setlist_select_acked();
+void setlist_slot_overwritten();
+unsigned long setlist_wait();
+void setlist_report();
+
+#endif
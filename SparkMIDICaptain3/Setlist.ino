@@ -0,0 +1,118 @@
+#include "Setlist.h"
+
+// start uploading a setlist entry into the temporary slot
+void setlist_load(int pos) {
+  SparkPreset p;
+
+  p = *my_presets[setlist[pos]];
+  p.preset_num = TMP_PRESET_ADDR;
+  spark_msg_out.create_preset(&p);
+  spark_upload_start();
+  setlist_loaded = -1;                    // whatever was there is being overwritten
+  setlist_loading = pos;
+}
+
+// change to the temporary slot, which has setlist_pos in it
+void setlist_select() {
+  clear_param_changes();
+  presets[TMP_PRESET][current_input] = *my_presets[setlist[setlist_pos]];
+  presets[TMP_PRESET][current_input].preset_num = TMP_PRESET_ADDR;
+  presets[CUR_EDITING][current_input] = presets[TMP_PRESET][current_input];
+  spark_msg_out.change_hardware_preset(0, TMP_PRESET_ADDR);
+  spark_queue();
+  setlist_selecting = true;
+  setlist_select_time = millis();
+  setlist_switch_pending = false;
+  setlist_switches++;
+  setlist_last_switch_us = micros() - setlist_press_time;
+  DEB("Setlist ");
+  DEB(setlist_pos);
+  DEB(" ");
+  DEBUG(presets[CUR_EDITING][current_input].Name);
+}
+
+void setlist_go(int pos) {
+  if (pos < 0 || pos >= setlist_len) return;
+  setlist_pos = pos;
+  setlist_switch_pending = true;
+  setlist_press_time = micros();
+  if (setlist_loaded == pos) setlist_prefetched++;
+  update_setlist();
+}
+
+// 0x0438 from the amp
+void setlist_select_acked() {
+  setlist_selecting = false;
+}
+
+// something else has been uploaded to 0x7f
+void setlist_slot_overwritten() {
+  setlist_loaded = -1;
+  setlist_loading = -1;
+}
+
+// ms until the select ack times out, so loop() doesn't sleep through it
+unsigned long setlist_wait() {
+  unsigned long since;
+
+  if (!setlist_selecting) return LOOP_MAX_WAIT;
+  since = millis() - setlist_select_time;
+  return (since >= SETLIST_SELECT_TIMEOUT) ? 0 : SETLIST_SELECT_TIMEOUT - since;
+}
+
+// called every loop() - keep the temporary slot holding whatever is wanted next
+void update_setlist() {
+  int want;
+
+  if (spark_state != SPARK_SYNCED) {
+    // no telling what the slot has in it after a reconnect
+    if (setlist_loading >= 0) spark_upload_abort();
+    setlist_loaded = -1;
+    setlist_loading = -1;
+    setlist_selecting = false;
+    return;
+  }
+
+  if (setlist_loading >= 0 && !spark_upload_busy()) {
+    // if it was cut short it is loaded again below
+    if (spark_upload_done()) setlist_loaded = setlist_loading;
+    setlist_loading = -1;
+  }
+  if (setlist_switch_pending && setlist_loaded == setlist_pos) 
+    setlist_select();
+
+  // nothing new goes into the slot until the amp has taken the last one out of it, or one is still going over
+  if (setlist_selecting) {
+    if (millis() - setlist_select_time < SETLIST_SELECT_TIMEOUT) return;
+    setlist_selecting = false;
+    setlist_select_timeouts++;
+  }
+  if (spark_upload_busy()) return;
+
+  want = setlist_switch_pending ? setlist_pos : setlist_pos + 1;
+  if (want < setlist_len && setlist_loaded != want && setlist_loading != want) 
+    setlist_load(want);
+}
+
+void setlist_report() {
+  Serial.print("Setlist position: ");
+  Serial.print(setlist_pos);
+  Serial.print(" of ");
+  Serial.print(setlist_len);
+  Serial.print("  temp slot has: ");
+  Serial.print(setlist_loaded);
+  Serial.print("  loading: ");
+  Serial.println(setlist_loading);
+  Serial.print("Switches: ");
+  Serial.print(setlist_switches);
+  Serial.print("  prefetched: ");
+  Serial.print(setlist_prefetched);
+  Serial.print("  last switch: ");
+  Serial.print(setlist_last_switch_us);
+  Serial.print(" us  select ack timeouts: ");
+  Serial.println(setlist_select_timeouts);
+  Serial.print("Upload blocks: ");
+  Serial.print(spark_upload.blocks);
+  Serial.print("  ack timeouts: ");
+  Serial.println(spark_upload.timeouts);
+}
@@ -67,9 +67,42 @@ void change_reverb_param(int param, float val);
 void change_hardware_preset(int pres_num);
 void change_custom_preset(SparkPreset *preset, int pres_num);
 
+// what the last change_custom_preset() cost
+bool custom_switch_diff;                  // sent as a diff rather than the whole preset
+int custom_switch_bytes;
+unsigned long custom_switch_us;           // until the amp acked it
+bool custom_switch_acked;                 // false if that timed out
+
+int preset_diff(SparkPreset *from, SparkPreset *to, bool send, int *blocks);
+int preset_upload_bytes(SparkPreset *preset, int *blocks);
+void preset_diff_report();
+
 void tuner_on_off(bool on_off);
 void send_tap_tempo(float tempo);
 
+// coalescing of parameter changes - only the latest value for each (input, slot, param) is kept 
+// and they are sent at most once every param_flush_interval ms, which 'param <ms>' on the console sets
+#define PARAM_FLUSH_INTERVAL 30
+
+struct param_change {
+  bool pending;
+  float val;
+};
+
+param_change param_changes[2][7][10];
+int param_changes_pending = 0;
+unsigned long param_flush_interval = PARAM_FLUSH_INTERVAL;
+unsigned long param_flush_timer;
+
+void flush_param_changes();
+void clear_param_changes();
+
+// a new model takes a while to load, so a model change is sent on its own and nothing follows it until the
+// amp acks it (0x0406) or MODEL_SETTLE_TIMEOUT passes - the same 100ms the model changes used to wait
+#define MODEL_SETTLE_TIMEOUT 100
+
+void model_change_settle();
+
 #define AMP_GAIN 0
 #define AMP_TREBLE 1
 #define AMP_MID 2
@@ -3,15 +3,15 @@
 
 void dump_preset(SparkPreset preset)
 {
-  Serial.print("Preset: ");
-  Serial.println(preset.Name);
-  Serial.print("Current : preset ");
-  Serial.print(preset.curr_preset);
-  Serial.print(" ");
-  Serial.println(preset.preset_num);  
+  DEB("Preset: ");
+  DEBUG(preset.Name);
+  DEB("Current : preset ");
+  DEB(preset.curr_preset);
+  DEB(" ");
+  DEBUG(preset.preset_num);  
   for (int i = 0; i < 7; i++) {
-    Serial.print("  ");
-    Serial.println(preset.effects[i].EffectName);
+    DEB("  ");
+    DEBUG(preset.effects[i].EffectName);
   }
 }
 
@@ -235,6 +235,7 @@ bool spark_state_tracker_start() {
 bool  update_spark_state() {
   int pres, ind;
   int input;
+  const spark_model *m;
   
   // sort out connection and sync progress
   if (!ble_spark_connected) {
@@ -284,16 +285,22 @@ bool  update_spark_state() {
         dump_preset(presets[pres][input]);
         
         break;
-      // change of amp model
+      // change of amp model - a model not in the catalog has no parameters until a preset says how many,
+      // so none are sent for it rather than ones the old model had
       case 0x0306:
         strcpy(presets[CUR_EDITING][current_input].effects[3].EffectName, msg.str2);
+        m = model_find(msg.str2);
+        presets[CUR_EDITING][current_input].effects[3].NumParameters = (m != NULL) ? m->num_params : 0;
         break;
       // change of effect
       case 0x0106:
         ind = get_effect_index(msg.str1);
-        if (ind >= 0) 
+        if (ind >= 0) {
           strcpy(presets[CUR_EDITING][current_input].effects[ind].EffectName, msg.str2);
-          setting_modified = true;
+          m = model_find(msg.str2);
+          presets[CUR_EDITING][current_input].effects[ind].NumParameters = (m != NULL) ? m->num_params : 0;
+        }
+        setting_modified = true;
         break;
       // effect on/off  
       case 0x0315:
@@ -365,6 +372,13 @@ bool  update_spark_state() {
       
       case 0x0438:
         setting_modified = false;
+        setlist_select_acked();
+        break;
+
+      // a block of a background preset upload has arrived
+      case 0x0401:
+      case 0x0501:
+        spark_upload_ack();
         break;
 
       default:
@@ -460,14 +474,53 @@ void set_input1() {
 
 ///// ROUTINES TO CHANGE AMP SETTINGS
 
+// change a slot to a model from the catalog and send the catalog's values for all its parameters, so the amp
+// and presets[CUR_EDITING] agree on every one
+void change_model(const spark_model *m, bool app) {
+  SparkPreset::SparkEffects *fx;
+  int param;
+
+  fx = &presets[CUR_EDITING][current_input].effects[m->slot];
+  if (strcmp(fx->EffectName, m->name) == 0) return;
+
+  set_input1();
+  spark_msg_out.change_effect_input(fx->EffectName, (char *) m->name, current_input);
+  spark_queue();
+  if (app) {
+    app_msg_out.change_effect_input(fx->EffectName, (char *) m->name, current_input);
+    app_queue();
+  }
+  model_change_settle();
+  model_set(fx, m);
+  for (param = 0; param < m->num_params; param++) {
+    spark_msg_out.change_effect_parameter_input(fx->EffectName, param, fx->Parameters[param], current_input);
+    spark_queue();
+    if (app) {
+      app_msg_out.change_effect_parameter_input(fx->EffectName, param, fx->Parameters[param], current_input);
+      app_queue();
+    }
+  }
+}
+
+// after a model change has been queued
+void model_change_settle() {
+  if (!spark_wait_ack(0x0406, -1, MODEL_SETTLE_TIMEOUT)) 
+    DEBUG("No ack for the model change");
+}
+
+// a name that isn't a model for the slot in the catalog is ignored
 void change_generic_model(char *new_eff, int slot) {
-  if (strcmp(presets[CUR_EDITING][current_input].effects[slot].EffectName, new_eff) != 0) {
-    set_input1();
-    spark_msg_out.change_effect_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, new_eff, current_input);
-    strcpy(presets[CUR_EDITING][current_input].effects[slot].EffectName, new_eff);
-    spark_send();
-    delay(100);
+  const spark_model *m;
+
+  m = model_find(new_eff);
+  if (m == NULL || m->slot != slot) {
+    DEB("Not a model for slot ");
+    DEB(slot);
+    DEB(": ");
+    DEBUG(new_eff);
+    return;
   }
+  change_model(m, slot == 3);              // the app is only told about amp changes
 }
 
 void change_comp_model(char *new_eff) {
@@ -479,14 +532,7 @@ void change_drive_model(char *new_eff) {
 }
 
 void change_amp_model(char *new_eff) {
-  if (strcmp(presets[CUR_EDITING][current_input].effects[3].EffectName, new_eff) != 0) {
-    spark_msg_out.change_effect_input(presets[CUR_EDITING][current_input].effects[3].EffectName, new_eff, current_input);
-    app_msg_out.change_effect_input(presets[CUR_EDITING][current_input].effects[3].EffectName, new_eff, current_input);
-    strcpy(presets[CUR_EDITING][current_input].effects[3].EffectName, new_eff);
-    spark_send();
-    app_send();
-    delay(100);
-  }
+  change_generic_model(new_eff, 3);
 }
 
 void change_mod_model(char *new_eff) {
@@ -504,8 +550,8 @@ void change_generic_onoff(int slot,bool onoff) {
   spark_msg_out.turn_effect_onoff_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, onoff, current_input);
   app_msg_out.turn_effect_onoff_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, onoff, current_input);
   presets[CUR_EDITING][current_input].effects[slot].OnOff = onoff;
-  spark_send();
-  app_send();  
+  spark_queue();
+  app_queue();  
 }
 
 void change_noisegate_onoff(bool onoff) {
@@ -545,8 +591,8 @@ void change_generic_toggle(int slot) {
   spark_msg_out.turn_effect_onoff_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, new_onoff, current_input);
   app_msg_out.turn_effect_onoff_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, new_onoff, current_input);
   presets[CUR_EDITING][current_input].effects[slot].OnOff = new_onoff;
-  spark_send();
-  app_send();  
+  spark_queue();
+  app_queue();  
 }
 
 void change_noisegate_toggle() {
@@ -578,19 +624,53 @@ void change_reverb_toggle() {
 }
 
 
+// Parameter changes are coalesced - an expression pedal sweep creates far more CC messages than the BLE link
+// can carry, so only the latest value for each parameter is recorded here and flush_param_changes() sends it.
+// The value still pending when the pedal stops moving is always sent, so the amp ends up at the resting value.
+
 void change_generic_param(int slot, int param, float val) {
-  float diff;
-
-  // some code to reduce the number of changes
-  diff = presets[CUR_EDITING][current_input].effects[slot].Parameters[param] - val;
-  if (diff < 0) diff = -diff;
-  if (diff > 0.04) {
-    spark_msg_out.change_effect_parameter_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, param, val, current_input);
-    app_msg_out.change_effect_parameter_input(presets[CUR_EDITING][current_input].effects[slot].EffectName, param, val, current_input);
-    presets[CUR_EDITING][current_input].effects[slot].Parameters[param] = val;
-    spark_send();  
-    app_send();
+  param_change *pc;
+
+  if (param < 0 || param >= presets[CUR_EDITING][current_input].effects[slot].NumParameters) return;
+  pc = &param_changes[current_input][slot][param];
+  if (!pc->pending) {
+    if (presets[CUR_EDITING][current_input].effects[slot].Parameters[param] == val) return;
+    pc->pending = true;
+    param_changes_pending++;
   }
+  pc->val = val;
+}
+
+void flush_param_changes() {
+  int input, slot, param;
+  param_change *pc;
+
+  if (param_changes_pending == 0) return;
+  if (millis() - param_flush_timer < param_flush_interval) return;
+
+  for (input = 0; input < 2; input++)
+    for (slot = 0; slot < 7; slot++)
+      for (param = 0; param < 10; param++) {
+        pc = &param_changes[input][slot][param];
+        if (pc->pending && param >= presets[CUR_EDITING][input].effects[slot].NumParameters)
+          pc->pending = false;            // the model changed while it waited, and this one has fewer
+        if (pc->pending) {
+          spark_msg_out.change_effect_parameter_input(presets[CUR_EDITING][input].effects[slot].EffectName, param, pc->val, input);
+          app_msg_out.change_effect_parameter_input(presets[CUR_EDITING][input].effects[slot].EffectName, param, pc->val, input);
+          presets[CUR_EDITING][input].effects[slot].Parameters[param] = pc->val;
+          spark_queue();  
+          app_queue();
+          pc->pending = false;
+        }
+      }
+  param_changes_pending = 0;
+  param_flush_timer = millis();
+}
+
+// drop any changes not yet sent - used when the preset changes underneath them
+void clear_param_changes() {
+  memset(param_changes, 0, sizeof(param_changes));
+  param_changes_pending = 0;
 }
 
 void change_noisegate_param(int param, float val) {
@@ -624,36 +704,187 @@ void change_reverb_param(int param, float val){
 
 void change_hardware_preset(int pres_num) {
   if (pres_num >= 0 && pres_num <= max_preset) {  
+    clear_param_changes();
     presets[CUR_EDITING][current_input] = presets[pres_num][current_input];
     display_preset_num = pres_num;
     
     spark_msg_out.change_hardware_preset(0, pres_num);
     app_msg_out.change_hardware_preset(0, pres_num);  
-    spark_send();  
-    app_send();
+    spark_queue();  
+    app_queue();
+  }
+}
+
+// Preset diffs
+//
+// The amp only needs the model, on/off and parameter messages that turn what it has now into the new preset,
+// and these go in the usual batches without waiting for an ack for each block. A slot that changes model has
+// all its parameters sent, as the new model starts from its own defaults. A model change goes in a block on
+// its own and the rest waits for model_change_settle(), so a block never follows one. preset_diff() counts the bytes on
+// air (16 byte block headers included) - and queues the messages if send is true.
+// The amp doesn't ack an 0x0104, so a diff always ends with an on/off message (the last slot it touched, set
+// as it already is) and the 0x0415 for that says the amp has taken all of it.
+// Only the effects are compared. A preset with a different tempo can't be diffed, and preset_diff() returns -1
+// so the whole preset is sent, and a diff leaves the amp's name and other preset fields as they were.
+
+void diff_message(bool send, int *bytes, int *fill, int *blocks) {
+  int len;
+
+  len = spark_queued_len();
+  if (*fill == 0 || *fill + len > 173) {
+    *bytes += 16;
+    *fill = 16;
+    (*blocks)++;
+  }
+  *fill += len;
+  *bytes += len;
+  if (send) spark_queue();
+}
+
+int preset_diff(SparkPreset *from, SparkPreset *to, bool send, int *blocks) {
+  int slot, param, bytes, fill, last_slot;
+  bool new_model, last_onoff;
+
+  bytes = 0;
+  fill = 0;
+  *blocks = 0;
+  if (from->BPM != to->BPM) return -1;
+  last_slot = -1;
+  last_onoff = false;
+  for (slot = 0; slot < 7; slot++) {
+    new_model = strcmp(from->effects[slot].EffectName, to->effects[slot].EffectName) != 0;
+    if (!new_model && from->effects[slot].NumParameters == 0 && to->effects[slot].NumParameters > 0) 
+      return -1;                          // a model not in the catalog, whose values aren't known yet
+    if (new_model) {
+      spark_msg_out.change_effect_input(from->effects[slot].EffectName, to->effects[slot].EffectName, current_input);
+      diff_message(send, &bytes, &fill, blocks);
+      if (send) model_change_settle();
+      fill = 0;                           // the block ends here
+      last_slot = slot;
+      last_onoff = false;
+    }
+    if (from->effects[slot].OnOff != to->effects[slot].OnOff) {
+      spark_msg_out.turn_effect_onoff_input(to->effects[slot].EffectName, to->effects[slot].OnOff, current_input);
+      diff_message(send, &bytes, &fill, blocks);
+      last_slot = slot;
+      last_onoff = true;
+    }
+    for (param = 0; param < to->effects[slot].NumParameters; param++) {
+      if (new_model || from->effects[slot].Parameters[param] != to->effects[slot].Parameters[param]) {
+        spark_msg_out.change_effect_parameter_input(to->effects[slot].EffectName, param, to->effects[slot].Parameters[param], current_input);
+        diff_message(send, &bytes, &fill, blocks);
+        last_slot = slot;
+        last_onoff = false;
+      }
+    }
   }
+  if (last_slot >= 0 && !last_onoff) {
+    spark_msg_out.turn_effect_onoff_input(to->effects[last_slot].EffectName, to->effects[last_slot].OnOff, current_input);
+    diff_message(send, &bytes, &fill, blocks);
+  }
+  return bytes;
 }
 
+// bytes on air for the whole preset and the change to it, as spark_send() would send them
+int preset_upload_bytes(SparkPreset *preset, int *blocks) {
+  int len, chunks;
+
+  spark_msg_out.create_preset(preset);
+  len = spark_queued_len();
+  chunks = (len - 1) / 157 + 1;           // as add_headers() splits a 0x0101
+  spark_msg_out.change_hardware_preset(0, preset->preset_num);
+  *blocks = chunks + 1;
+  return len + 16 * chunks + spark_queued_len() + 16;
+}
+
+// pres_num is the slot the whole preset is stored in if it goes that way - a hardware preset or TMP_PRESET
+// a diff only changes what the amp has now, so no slot is written and only CUR_EDITING follows it
+// either way this waits for the amp's ack, so custom_switch_us is the time until the amp has the new preset
 void change_custom_preset(SparkPreset *preset, int pres_num) {
-  if (pres_num >= 0 && pres_num <= max_preset) {
+  unsigned long t;
+  int diff_bytes, full_bytes, blocks;
+
+  if ((pres_num >= 0 && pres_num <= max_preset) || pres_num == TMP_PRESET) {
+    t = micros();
+    clear_param_changes();
+    spark_upload_finish();                // the two uploads can't be mixed, and half of one can't be dropped
     preset->preset_num = (pres_num < num_presets) ? pres_num : 0x7f;
-    presets[CUR_EDITING][current_input] = *preset;
-    presets[pres_num][current_input] = *preset;
-    
-    spark_msg_out.create_preset(preset);
-    spark_send();  
-    spark_msg_out.change_hardware_preset(0, preset->preset_num);
-    spark_send();  
+
+    diff_bytes = preset_diff(&presets[CUR_EDITING][current_input], preset, false, &blocks);
+    full_bytes = preset_upload_bytes(preset, &blocks);
+    if (diff_bytes >= 0 && diff_bytes < full_bytes) {
+      preset_diff(&presets[CUR_EDITING][current_input], preset, true, &blocks);
+      custom_switch_acked = (diff_bytes == 0) || spark_wait_ack(0x0415, spark_queued_sequence(), UPLOAD_ACK_TIMEOUT);
+      flush_sparkIO();
+      custom_switch_diff = true;
+      custom_switch_bytes = diff_bytes;
+      memcpy(presets[CUR_EDITING][current_input].effects, preset->effects, sizeof(preset->effects));
+    }
+    else {
+      if (preset->preset_num == 0x7f) 
+        setlist_slot_overwritten();
+      spark_msg_out.create_preset(preset);
+      spark_send();  
+      spark_msg_out.change_hardware_preset(0, preset->preset_num);
+      spark_send();  
+      custom_switch_acked = spark_wait_ack(0x0438, -1, UPLOAD_ACK_TIMEOUT);
+      presets[pres_num][current_input] = *preset;
+      presets[CUR_EDITING][current_input] = *preset;
+      custom_switch_diff = false;
+      custom_switch_bytes = full_bytes;
+    }
+    custom_switch_us = micros() - t;
   }
 }
 
+// bytes and blocks for every pair of presets in SparkPresets.h, whole preset against the diff
+// a whole preset waits for an ack after each block, the blocks of a diff don't
+void preset_diff_report() {
+  SparkPreset from, to;
+  int i, j, n, diff_bytes, diff_blocks, full_bytes, full_blocks, wins, diffable;
+  long diff_total, full_total;
+  char line[120];
+
+  n = sizeof(my_presets) / sizeof(SparkPreset *);
+  wins = 0;
+  diffable = 0;
+  diff_total = 0;
+  full_total = 0;
+  Serial.println("from to  diff bytes blocks  full bytes blocks");
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++) {
+      if (i == j) continue;
+      from = *my_presets[i];
+      to = *my_presets[j];
+      diff_bytes = preset_diff(&from, &to, false, &diff_blocks);
+      full_bytes = preset_upload_bytes(&to, &full_blocks);
+      full_total += full_bytes;
+      if (diff_bytes < 0) {
+        sprintf(line, "%4d %2d  %10s %6s  %10d %6d", i, j, "tempo", "-", full_bytes, full_blocks);
+        Serial.println(line);
+        continue;
+      }
+      if (diff_bytes < full_bytes) wins++;
+      diffable++;
+      diff_total += diff_bytes;
+      sprintf(line, "%4d %2d  %10d %6d  %10d %6d", i, j, diff_bytes, diff_blocks, full_bytes, full_blocks);
+      Serial.println(line);
+    }
+  sprintf(line, "Diff smaller for %d of %d pairs (%d with a different tempo can't be diffed), mean %ld bytes against %ld", 
+          wins, n * (n - 1), n * (n - 1) - diffable, diffable > 0 ? diff_total / diffable : 0L, full_total / (n * (n - 1)));
+  Serial.println(line);
+  sprintf(line, "Last switch: %s %d bytes %lu us%s", custom_switch_diff ? "diff" : "whole preset", 
+          custom_switch_bytes, custom_switch_us, custom_switch_acked ? "" : " (no ack)");
+  Serial.println(line);
+}
+
 void tuner_on_off(bool on_off) {
   spark_msg_out.tuner_on_off(on_off); 
-  spark_send();  
+  spark_queue();  
 }
 
 
 void send_tap_tempo(float tempo) {
   spark_msg_out.send_tap_tempo(tempo);
-  spark_send();    
+  spark_queue();    
 };
\ No newline at end of file
@@ -22,9 +22,15 @@ char *spark_bt_name;
 //#define BLE_DUMP 
 
 #define DEBUG_ON
+#define DEFERRED_LOG      // DEB and DEBUG are written to Serial by a low priority task - see DeferredLog.h
+
+#include "DeferredLog.h"
 
 #ifndef DEBUG
-  #ifdef DEBUG_ON
+  #if defined DEBUG_ON && defined DEFERRED_LOG
+    #define DEB(...) dlog.print(__VA_ARGS__) 
+    #define DEBUG(...) dlog.println(__VA_ARGS__) 
+  #elif defined DEBUG_ON
   // found this hint with __VA_ARGS__ on the web, it accepts different sets of arguments /Copych
     #define DEB(...) Serial.print(__VA_ARGS__) 
     #define DEBUG(...) Serial.println(__VA_ARGS__) 
@@ -75,10 +81,34 @@ bool ble_passthru;
 #define S_CHAR1   "ffc1"
 #define S_CHAR2   "ffc2"
 
-#define MAX_SPARK_SCAN_COUNT 10
-#define MAX_PEDAL_SCAN_COUNT 2
+// Discovery is one scan, and each advertisement is looked at as it arrives - for the Spark's service, and
+// for the pedal's service or name. The scan stops when the Spark has been found and either the pedal has
+// too or SCAN_PEDAL_DEADLINE has passed, so a rig with no pedal waits for nothing more than that.
+#define SCAN_SPARK_TIMEOUT 40000          // ms - no Spark heard in this time and connect_to_all() fails
+#define SCAN_PEDAL_DEADLINE 1500          // ms after the Spark is found that a pedal is still waited for
+
+// Known devices
+//
+// After a scan finds them, the Spark's and the pedal's addresses, the Spark's BLE name and spark_type are kept
+// in NVS, and later boots connect to them directly with no scan. If the Spark doesn't connect within
+// BLE_CONNECT_TIMEOUT the scan runs as before, and what it finds replaces them. A cached pedal that doesn't
+// connect is left out for that boot. 'ble forget' on the console clears them so the next boot scans.
+#include <Preferences.h>
+
+#define KNOWN_DEVICES_NVS "spark_midi"    // NVS namespace
+#define BLE_CONNECT_TIMEOUT 2000          // ms
+
+Preferences known_devices;
+bool direct_connect;                      // this boot connected to the known devices without a scan
+
+bool load_known_devices();
+void save_known_devices();
+void forget_known_devices();
+void ble_report();
 
 bool connect_to_all();
+void new_spark_client();
+void new_pedal_client();
 void connect_spark();
 
 void send_to_spark(); 
@@ -94,7 +124,10 @@ bool ble_spark_connected;
 bool bt_app_connected;
 
 bool connected_sp;
-bool found_sp;
+volatile bool found_sp;                   // set from the scan callback
+unsigned long spark_found_time;
+unsigned long scan_time;                  // ms from the start of the scan to finding the Spark, 0 if there was no scan
+unsigned long connect_time;               // ms from the start of connect_to_all() to the Spark and pedal being connected
 
 BLEServer *pServer;
 BLEService *pService;
@@ -122,9 +155,8 @@ BLEAddress sp_address;
 void connect_pedal();
 
 bool connected_pedal;
-bool found_pedal;
+volatile bool found_pedal;
 
-RingBuffer midi_in;
 
 BLEClient *pClient_pedal;
 BLERemoteService *pService_pedal;
@@ -113,21 +113,18 @@ void notifyCB_sp(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData,
   struct packet_data qe;
   new_packet_from_data(&qe, pData, length);
   xQueueSend (qFromSpark, &qe, (TickType_t) 0);
+  TRACE(TR_QUEUE_FROM_SPARK, length);
+  loop_signal(EV_FROM_SPARK);
 }
 
 
 // This works with IK Multimedia iRig Blueboard and the Akai LPD8 wireless - interestingly they have the same UUIDs
+// Each notification is one BLE-MIDI packet
 void notifyCB_pedal(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify){
-
-  int i;
-  byte b;
-
-  for (i = 0; i < length; i++) {
-    b = pData[i];
-    midi_in.add(b);
-  }
-  midi_in.commit();
-
+#ifdef BLE_MIDI
+  ble_midi.parse_packet(pData, length, micros());
+  loop_signal(EV_MIDI_BLE);
+#endif
 }
 
 
@@ -148,6 +145,8 @@ class CharacteristicCallbacks: public BLECharacteristicCallbacks {
     struct packet_data qe;
     new_packet_from_data(&qe, (uint8_t *) buf, size);
     xQueueSend (qFromApp, &qe, (TickType_t) 0);
+    TRACE(TR_QUEUE_FROM_APP, size);
+    loop_signal(EV_FROM_APP);
   };
 };
 
@@ -181,6 +180,7 @@ void data_callback(const uint8_t *buffer, size_t size) {
     struct packet_data qe;
     new_packet_from_data(&qe, (uint8_t *) buffer, size);
     xQueueSend (qFromApp, &qe, (TickType_t) 0);
+    loop_signal(EV_FROM_APP);
 
 }
 
@@ -189,6 +189,147 @@ BLEUUID SpServiceUuid(C_SERVICE);
 // BLE pedal
 BLEUUID PedalServiceUuid(PEDAL_SERVICE);
 
+void set_spark_type(const char *name) {
+  if (strstr(name, "40") != NULL) 
+    spark_type = S40;
+  else if (strstr(name, "GO") != NULL)
+    spark_type = GO;
+  else if (strstr(name, "MINI") != NULL)        
+    spark_type = MINI;  
+  else if (strstr(name, "LIVE") != NULL)     
+    spark_type = LIVE; 
+  else if (strstr(name, "Spark 2") != NULL)     
+    spark_type = SPARK2; 
+  else {
+    DEBUG("Couldn't match Spark type");
+    spark_type = NONE;
+  }
+}
+
+// scan callback - runs in the NimBLE host task for each device heard, and only records what it finds
+class ScanCallbacks: public NimBLEScanCallbacks {
+  void onResult(const NimBLEAdvertisedDevice *dev) {
+    if (!found_sp && dev->isAdvertisingService(SpServiceUuid)) {
+      strncpy(spark_ble_name, dev->getName().c_str(), SIZE_BLE_NAME);
+      DEB("Found '");
+      DEB(spark_ble_name);
+      DEBUG("'");
+      set_spark_type(spark_ble_name);
+      sp_address = dev->getAddress();
+      connected_sp = false;
+      spark_found_time = millis();
+      found_sp = true;
+    }
+    else if (!found_pedal && (dev->isAdvertisingService(PedalServiceUuid) 
+                              || strcmp(dev->getName().c_str(), "iRig BlueBoard") == 0
+                              || strcmp(dev->getName().c_str(), "WIDI Jack") == 0)) {
+      DEBUG("Found BLE MIDI device");
+      pedal_address = dev->getAddress();
+      connected_pedal = false;
+      found_pedal = true;
+    }
+  }
+};
+
+static ScanCallbacks scan_callbacks;
+
+// one scan for everything - true if the Spark was found
+bool scan_for_devices() {
+  unsigned long start;
+
+  found_sp = false;
+  found_pedal = false;
+  start = millis();
+
+  DEBUG("Scanning for Spark and BLE MIDI device");
+  pScan->setScanCallbacks(&scan_callbacks, false);
+  pScan->start(SCAN_SPARK_TIMEOUT, false, true);
+  while (pScan->isScanning()) {
+    if (found_sp && (found_pedal || millis() - spark_found_time >= SCAN_PEDAL_DEADLINE)) break;
+    delay(10);
+  }
+  pScan->stop();                          // can't connect while still scanning
+  pScan->clearResults();
+
+  if (found_sp) scan_time = spark_found_time - start;
+  return found_sp;
+}
+
+// the devices from the last scan - sets sp_address and the rest, and false if there aren't any
+bool load_known_devices() {
+  String sp, pd;
+
+  if (!known_devices.begin(KNOWN_DEVICES_NVS, true)) return false;
+  sp = known_devices.getString("sp_addr", "");
+  if (sp.length() == 0) {
+    known_devices.end();
+    return false;
+  }
+  sp_address = BLEAddress(std::string(sp.c_str()), known_devices.getUChar("sp_type", 0));
+  strncpy(spark_ble_name, known_devices.getString("sp_name", DEFAULT_SPARK_BLE_NAME).c_str(), SIZE_BLE_NAME);
+  spark_type = (decltype(spark_type)) known_devices.getUChar("spark_type", NONE);
+  pd = known_devices.getString("pd_addr", "");
+  if (pd.length() > 0)
+    pedal_address = BLEAddress(std::string(pd.c_str()), known_devices.getUChar("pd_type", 0));
+  known_devices.end();
+
+  found_sp = true;
+  found_pedal = pd.length() > 0;
+  return true;
+}
+
+// only a pedal that connected is kept
+void save_known_devices() {
+  if (!known_devices.begin(KNOWN_DEVICES_NVS, false)) return;
+  known_devices.putString("sp_addr", sp_address.toString().c_str());
+  known_devices.putUChar("sp_type", sp_address.getType());
+  known_devices.putString("sp_name", spark_ble_name);
+  known_devices.putUChar("spark_type", spark_type);
+  known_devices.putString("pd_addr", connected_pedal ? pedal_address.toString().c_str() : "");
+  known_devices.putUChar("pd_type", connected_pedal ? pedal_address.getType() : 0);
+  known_devices.end();
+}
+
+void forget_known_devices() {
+  if (!known_devices.begin(KNOWN_DEVICES_NVS, false)) return;
+  known_devices.clear();
+  known_devices.end();
+}
+
+void ble_report() {
+  Serial.print(direct_connect ? "Connected directly" : "Connected after a scan");
+  Serial.print("  Spark found in: ");
+  Serial.print(scan_time);
+  Serial.print(" ms  connected in: ");
+  Serial.print(connect_time);
+  Serial.println(" ms");
+  Serial.print("Spark: ");
+  Serial.print(spark_ble_name);
+  Serial.print(" ");
+  Serial.print(sp_address.toString().c_str());
+  Serial.println(connected_sp ? " connected" : " not connected");
+  Serial.print("Pedal: ");
+  if (found_pedal) {
+    Serial.print(pedal_address.toString().c_str());
+    Serial.println(connected_pedal ? " connected" : " not connected");
+  }
+  else
+    Serial.println("none");
+}
+
+// a client for the Spark, and one for the pedal - made again after a failed subscribe has deleted the old one,
+// so a retry or the fallback scan never uses a freed client
+void new_spark_client() {
+  pClient_sp = BLEDevice::createClient();
+  pClient_sp->setClientCallbacks(new MyClientCallback());
+  pClient_sp->setConnectTimeout(BLE_CONNECT_TIMEOUT);
+}
+
+void new_pedal_client() {
+  pClient_pedal = BLEDevice::createClient();
+  pClient_pedal->setConnectTimeout(BLE_CONNECT_TIMEOUT);
+}
+
 void connect_spark() {
   if (found_sp && !connected_sp) {
     if (pClient_sp != nullptr && pClient_sp->isConnected())
@@ -213,8 +354,11 @@ void connect_spark() {
 #else
           if (!pReceiver_sp->subscribe(true, notifyCB_sp, true)) {
             connected_sp = false;
+            ble_spark_connected = false;
             DEBUG("Spark disconnected");
             NimBLEDevice::deleteClient(pClient_sp);
+            new_spark_client();
+            return;
           }   
 #endif
         } 
@@ -250,6 +394,8 @@ void connect_pedal() {
             connected_pedal = false;
             DEBUG("Pedal disconnected");
             NimBLEDevice::deleteClient(pClient_pedal);
+            new_pedal_client();
+            return;
           } 
 #endif
         }
@@ -262,10 +408,8 @@ void connect_pedal() {
 
 
 bool connect_to_all() {
-  int i, j;
-  int counts;
+  unsigned long scan_start;
   uint8_t b;
-  int len;
 
 
   // init comms processing
@@ -278,11 +422,10 @@ bool connect_to_all() {
 
   BLEDevice::init(spark_ble_name);        // put here for CLASSIC code
   BLEDevice::setMTU(517);
-  pClient_sp = BLEDevice::createClient();
-  pClient_sp->setClientCallbacks(new MyClientCallback());
+  new_spark_client();
  
   // BLE pedal
-  pClient_pedal = BLEDevice::createClient();
+  new_pedal_client();
 
 
   BLEDevice::getScan()->setInterval(40);
@@ -327,68 +470,33 @@ bool connect_to_all() {
   connected_pedal = false;
   found_pedal = false;
 
-  DEBUG("Scanning for Spark");
-
-  counts = 0;
-  while (!found_sp && counts < MAX_SPARK_SCAN_COUNT) {   // assume we only use a pedal if on already and hopefully found at same time as Spark, don't wait for it
-    counts++;
-    pResults = pScan->getResults(4000);
-    
-    for(i = 0; i < pResults.getCount()  && !found_sp; i++) {
-      device = pResults.getDevice(i);
-
-      if (device->isAdvertisingService(SpServiceUuid)) {
-        strncpy(spark_ble_name, device->getName().c_str(), SIZE_BLE_NAME);
-
-        DEB("Found '");
-        DEB(spark_ble_name);
-        DEBUG("'");
-
-        if (strstr(spark_ble_name, "40") != NULL) 
-          spark_type = S40;
-        else if (strstr(spark_ble_name, "GO") != NULL)
-          spark_type = GO;
-        else if (strstr(spark_ble_name, "MINI") != NULL)        
-          spark_type = MINI;  
-        else if (strstr(spark_ble_name, "LIVE") != NULL)     
-          spark_type = LIVE; 
-        else if (strstr(spark_ble_name, "Spark 2") != NULL)     
-          spark_type = SPARK2; 
-        else {
-          DEBUG("Couldn't match Spark type");
-          spark_type = NONE;
-        }
-
-        found_sp = true;
-        connected_sp = false;
-        sp_address = device->getAddress();
-      }
+  scan_start = millis();
+  scan_time = 0;
+  direct_connect = load_known_devices();
+  if (direct_connect) {
+    DEBUG("Connecting to the Spark from last time");
+    connect_spark();
+    if (connected_sp) 
+      connect_pedal();
+    else {
+      DEBUG("Spark didn't connect, scanning");
+      direct_connect = false;
     }
   }
-
-  DEBUG("Scanning for BLE MIDI device");
-
-  counts = 0;
-  while (!found_pedal && counts < MAX_PEDAL_SCAN_COUNT) {  
-    counts++;
-    pResults = pScan->getResults(4000);
-    
-    for(i = 0; i < pResults.getCount()  && !found_pedal; i++) {
-      device = pResults.getDevice(i);
-      if (device->isAdvertisingService(PedalServiceUuid) 
-         || strcmp(device->getName().c_str(),"iRig BlueBoard") == 0
-         || strcmp(device->getName().c_str(),"WIDI Jack") == 0) {
-        DEBUG("Found BLE MIDI device");
-        found_pedal = true;
-        connected_pedal = false;
-        pedal_address= device->getAddress();
-      }
-    }
+  if (!direct_connect) {
+    if (!scan_for_devices()) return false;  // no Spark within SCAN_SPARK_TIMEOUT
+    connect_spark();
+    connect_pedal();
+    if (connected_sp) save_known_devices();
   }
-
-  if (!found_sp) return false;   // failed to find the Spark within the number of counts allowed (MAX_SCAN_COUNT)
-  connect_spark();
-  connect_pedal();
+  connect_time = millis() - scan_start;
+  DEB(direct_connect ? "Connected directly in " : "Spark found in ");
+  if (!direct_connect) {
+    DEB(scan_time);
+    DEB(" ms, connected in ");
+  }
+  DEB(connect_time);
+  DEBUG(" ms");
 
 #ifdef CLASSIC
   DEBUG("Starting classic bluetooth");
@@ -457,11 +565,13 @@ bool connect_to_all() {
 }
 
 void send_to_spark(byte *buf, int len) {
+  TRACE(TR_SEND_SPARK, len);
   pSender_sp->writeValue(buf, len, false);
 }
 
 
 void send_to_app(byte *buf, int len) {
+  TRACE(TR_SEND_APP, len);
   if (ble_app_connected) {
     //pCharacteristic_send->setValue(buf, len);
     //pCharacteristic_send->notify(true);
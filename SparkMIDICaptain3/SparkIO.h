@@ -18,6 +18,7 @@ class MessageIn
     };
 
     bool check_for_acknowledgement();
+    bool has_acknowledgement(unsigned int ack, int sequence, int from);
     bool get_message(unsigned int *cmdsub, SparkMessage *msg, SparkPreset *preset);
     
     CircularArray message_in;
@@ -100,6 +101,42 @@ void process_sparkIO();
 void spark_send();
 void app_send();
 
+// small messages can be queued and sent together in one 0x01fe block by flush_sparkIO()
+void spark_queue();
+void app_queue();
+void flush_sparkIO();
+int spark_queued_len();
+int spark_queued_sequence();
+
+// wait for the amp to ack one message, without losing anything else it sends
+bool spark_wait_ack(unsigned int ack, int sequence, unsigned long timeout);
+
+// a preset can be sent in the background by update_spark_upload(), one block each time the amp acknowledges
+// the last, instead of spark_send() waiting for all of them
+#define UPLOAD_ACK_TIMEOUT 400            // ms - same as spark_send()
+
+struct spark_upload_t {
+  byte buf[OUT_BLOCK_SIZE];
+  int len;
+  int pos;                                // next byte to send
+  bool active;
+  bool waiting;                           // for the ack to the last block
+  unsigned long sent_time;
+  unsigned long blocks;
+  unsigned long timeouts;
+};
+
+spark_upload_t spark_upload;
+
+void spark_upload_start();
+void spark_upload_ack();
+void spark_upload_abort();
+void spark_upload_finish();
+bool spark_upload_busy();
+bool spark_upload_done();
+unsigned long spark_upload_wait();
+void update_spark_upload();
+
 void init_sparkIO();
 
 #endif
@@ -368,6 +368,7 @@ void handle_spark_packet() {
   while (uxQueueMessagesWaiting(qFromSpark) > 0) {
     lastSparkPacketTime = millis();
     xQueueReceive(qFromSpark, &qe, (TickType_t) 0);
+    TRACE(TR_PACKET_SPARK, qe.size);
 
     // passthru
     if (ble_passthru) {
@@ -405,7 +406,7 @@ void handle_spark_packet() {
   // check for timeouts and delete the packet, it took too long to get a proper packet
   if ((array_spark.length() > 0) && (millis() - lastSparkPacketTime > SPARK_TIMEOUT)) {
     array_spark.clear();
-    Serial.println("CLEARED SPARK");
+    DEBUG("CLEARED SPARK");
   }
 }
 
@@ -422,6 +423,7 @@ void handle_app_packet() {
   while (uxQueueMessagesWaiting(qFromApp) > 0) {
     lastAppPacketTime = millis();
     xQueueReceive(qFromApp, &qe, (TickType_t) 0);
+    TRACE(TR_PACKET_APP, qe.size);
 
     if (ble_passthru) {
       send_to_spark(qe.ptr, qe.size);
@@ -458,7 +460,7 @@ void handle_app_packet() {
   // check for timeouts and delete the packet, it took too long to get a proper packet
   if ((array_app.length() > 0) && (millis() - lastAppPacketTime > APP_TIMEOUT)) {
     array_app.clear();
-    Serial.println("CLEARED APP");
+    DEBUG("CLEARED APP");
   }
 
 }
@@ -817,6 +819,7 @@ bool MessageIn::get_message(unsigned int *cmdsub, SparkMessage *msg, SparkPreset
 
 
   *cmdsub = cs;
+  TRACE(TR_GET_MESSAGE, cs);
   switch (cs) {
     // 0x02 series - requests
     // get preset information
@@ -1330,6 +1333,24 @@ bool MessageIn::check_for_acknowledgement() {
     return false;
 };
 
+// looks for an ack from byte 'from' on without reading anything, so get_message() still sees every message
+// sequence -1 matches any sequence number
+bool MessageIn::has_acknowledgement(unsigned int ack, int sequence, int from) {
+  unsigned int len;
+  unsigned int cs;
+  int pos;
+
+  pos = from;
+  while (pos + 6 <= message_in.length()) {
+    bytes_to_uint(message_in[pos], message_in[pos + 1], &cs);
+    bytes_to_uint(message_in[pos + 2], message_in[pos + 3], &len);
+    if (cs == ack && (sequence < 0 || message_in[pos + 5] == sequence)) return true;
+    if (len == 0) return false;
+    pos += len;
+  }
+  return false;
+}
+
 
 // ------------------------------------------------------------------------------------------------------------
 // MessageOut class
@@ -1961,6 +1982,120 @@ int add_headers(byte *out_block, byte *in_block, int in_len) {
 
 byte block_out_temp[OUT_BLOCK_SIZE];
 
+// ------------------------------------------------------------------------------------------------------------
+// Batching of small messages
+//
+// spark_queue() and app_queue() encode the message into f001 chunks and pack it into a pending 0x01fe block
+// rather than writing it straight away. flush_sparkIO() writes each pending block once per loop.
+// A message that won't fit in a block on its own (a preset) is sent with spark_send() / app_send() instead.
+// Each message in a block is given its own sequence number, starting from the usual 0x60.
+// ------------------------------------------------------------------------------------------------------------
+
+struct out_batch {
+  byte block[173];
+  int len;
+  int block_size;
+  int num_messages;
+  uint8_t *header;
+  void (*sender)(byte *buf, int len);
+  unsigned long writes;
+  unsigned long messages;
+};
+
+out_batch spark_batch {{}, 0, 173, 0, header_to_spark, send_to_spark, 0, 0};
+out_batch app_batch   {{}, 0, 106, 0, header_to_app,   send_to_app,   0, 0};
+
+void batch_flush(out_batch *batch) {
+  if (batch->len > 0) {
+    TRACE(TR_FLUSH_BATCH, batch->len);
+    batch->block[6] = batch->len;
+    batch->sender(batch->block, batch->len);
+    if (batch == &spark_batch) latency_sent();
+    batch->writes++;
+    batch->len = 0;
+    batch->num_messages = 0;
+  }
+}
+
+// returns false if the chunks can never fit in a block, and must be sent in the normal way
+bool batch_add(out_batch *batch, byte *chunks, int len) {
+  if (len + 16 > batch->block_size) return false;
+
+  if (batch->len + len > batch->block_size) 
+    batch_flush(batch);
+
+  if (batch->len == 0) {
+    memcpy(batch->block, batch->header, 16);
+    batch->len = 16;
+  }
+  chunks[2] = 0x60 + batch->num_messages;       // sequence number
+  memcpy(&batch->block[batch->len], chunks, len);
+  batch->len += len;
+  batch->num_messages++;
+  batch->messages++;
+  return true;
+}
+
+void spark_queue() {
+  int len;
+
+  if (spark_msg_out.buf_pos > 0) {
+    TRACE(TR_QUEUE_TO_SPARK, spark_msg_out.buffer[0] << 8 | spark_msg_out.buffer[1]);
+    len = expand(block_out_temp, spark_msg_out.buffer, spark_msg_out.buf_pos);
+    add_bit_eight(block_out_temp, len);
+    if (!batch_add(&spark_batch, block_out_temp, len)) 
+      spark_send();
+  }
+}
+
+void app_queue() {
+  int len;
+
+  if (app_msg_out.buf_pos > 0) {
+    TRACE(TR_QUEUE_TO_APP, app_msg_out.buffer[0] << 8 | app_msg_out.buffer[1]);
+    len = expand(block_out_temp, app_msg_out.buffer, app_msg_out.buf_pos);
+    add_bit_eight(block_out_temp, len);
+    if (!batch_add(&app_batch, block_out_temp, len)) 
+      app_send();
+  }
+}
+
+void flush_sparkIO() {
+  batch_flush(&spark_batch);
+  batch_flush(&app_batch);
+}
+
+// bytes the message in spark_msg_out would add to a batch, without queueing it
+int spark_queued_len() {
+  int len;
+
+  if (spark_msg_out.buf_pos == 0) return 0;
+  len = expand(block_out_temp, spark_msg_out.buffer, spark_msg_out.buf_pos);
+  add_bit_eight(block_out_temp, len);
+  return len;
+}
+
+// sequence number the last message queued was given
+int spark_queued_sequence() {
+  return 0x60 + spark_batch.num_messages - 1;
+}
+
+// sends anything queued and waits up to timeout ms for the ack
+// messages already waiting when it starts are not looked at, so an old ack doesn't count
+bool spark_wait_ack(unsigned int ack, int sequence, unsigned long timeout) {
+  unsigned long t;
+  int from;
+
+  batch_flush(&spark_batch);
+  from = spark_msg_in.message_in.length();
+  t = millis();
+  while ((millis() - t) < timeout) {
+    process_sparkIO();
+    if (spark_msg_in.has_acknowledgement(ack, sequence, from)) return true;
+  }
+  return false;
+}
+
 void spark_send() {
   int len;
   byte direction;
@@ -1974,6 +2109,9 @@ void spark_send() {
 
   uint8_t *block_out;
 
+  // anything queued must go first to keep the order of messages
+  batch_flush(&spark_batch);
+
   block_out = spark_msg_out.buffer;
   len = spark_msg_out.buf_pos;
 
@@ -1994,6 +2132,7 @@ void spark_send() {
     for (this_block = 0; this_block < num_blocks; this_block++) {
       this_len = (this_block == num_blocks - 1) ? last_block_len : block_size;
       send_to_spark(&block_out[this_block * block_size], this_len);
+      if (this_block == num_blocks - 1) latency_sent();
       //Serial.println("Sent a block");
 
       if (num_blocks != 1) {   // only do this for the multi blocks
@@ -2023,6 +2162,9 @@ void app_send() {
 
   uint8_t *block_out;
 
+  // anything queued must go first to keep the order of messages
+  batch_flush(&app_batch);
+
   block_out = app_msg_out.buffer;
   len = app_msg_out.buf_pos;
 
@@ -2045,3 +2187,91 @@ void app_send() {
     }
   }
 }
+
+// ------------------------------------------------------------------------------------------------------------
+// Background upload
+//
+// spark_upload_start() takes the message in spark_msg_out (a preset) and splits it into blocks as spark_send()
+// does, but update_spark_upload() sends them one per loop(), each once the amp has acknowledged the one before
+// or UPLOAD_ACK_TIMEOUT has passed. Anything queued in the meantime goes out between blocks, so the
+// controller isn't held up while a preset goes over.
+// ------------------------------------------------------------------------------------------------------------
+
+void spark_upload_start() {
+  int len;
+
+  if (spark_msg_out.buf_pos == 0) return;
+  len = expand(block_out_temp, spark_msg_out.buffer, spark_msg_out.buf_pos);
+  add_bit_eight(block_out_temp, len);
+  spark_upload.len = add_headers(spark_upload.buf, block_out_temp, len);
+  spark_msg_out.buf_pos = 0;
+  spark_upload.pos = 0;
+  spark_upload.waiting = false;
+  spark_upload.active = true;
+}
+
+// 0x0401 / 0x0501 from the amp
+void spark_upload_ack() {
+  spark_upload.waiting = false;
+}
+
+void spark_upload_abort() {
+  spark_upload.active = false;
+  spark_upload.waiting = false;
+  spark_upload.pos = 0;
+}
+
+// send the rest of the upload now, waiting for each ack as spark_send() does
+void spark_upload_finish() {
+  while (spark_upload.active) {
+    process_sparkIO();
+    if (spark_upload.waiting && spark_msg_in.check_for_acknowledgement()) 
+      spark_upload.waiting = false;
+    update_spark_upload();
+  }
+}
+
+bool spark_upload_busy() {
+  return spark_upload.active;
+}
+
+// the last upload went over in full
+bool spark_upload_done() {
+  return !spark_upload.active && spark_upload.len > 0 && spark_upload.pos >= spark_upload.len;
+}
+
+// ms until the ack timeout, so loop() doesn't sleep through it
+unsigned long spark_upload_wait() {
+  unsigned long since;
+
+  if (!spark_upload.active) return LOOP_MAX_WAIT;
+  if (!spark_upload.waiting) return 0;
+  since = millis() - spark_upload.sent_time;
+  return (since >= UPLOAD_ACK_TIMEOUT) ? 0 : UPLOAD_ACK_TIMEOUT - since;
+}
+
+void update_spark_upload() {
+  int this_len;
+
+  if (!spark_upload.active) return;
+  if (spark_upload.waiting) {
+    if (millis() - spark_upload.sent_time < UPLOAD_ACK_TIMEOUT) return;
+    spark_upload.timeouts++;
+  }
+  spark_upload.waiting = false;
+  if (spark_upload.pos >= spark_upload.len) {
+    spark_upload.active = false;
+    return;
+  }
+
+  // anything queued must go first to keep the order of messages
+  batch_flush(&spark_batch);
+
+  this_len = spark_upload.len - spark_upload.pos;
+  if (this_len > 173) this_len = 173;
+  send_to_spark(&spark_upload.buf[spark_upload.pos], this_len);
+  spark_upload.pos += this_len;
+  spark_upload.blocks++;
+  spark_upload.sent_time = millis();
+  spark_upload.waiting = true;            // the last block is acknowledged too
+}
@@ -14,35 +14,43 @@
 //#define CLASSIC
 //#define PSRAM
 
+#include "Trace.h"
 #include "SparkIO.h"
 #include "Spark.h"
+#include "Models.h"
 #include "Screen.h"
 #include "MIDI.h"
+#include "Latency.h"
+#include "Console.h"
+#include "LoopEvents.h"
+#include "MidiOut.h"
+#include "MidiClock.h"
+#include "MidiMerge.h"
+#include "MidiMap.h"
+#include "Macro.h"
+#include "SparkPresets.h"
+#include "Setlist.h"
 
 int my_preset;
 
 
-char *amps[]{"Twin","94MatchDCV2","RolandJC120","Bassman","AC Boost","AmericanHighGain","SLO100","YJM100","OrangeAD30","BE101","EVH","Rectifier","ADClean","Bogner","W600"};
-int num_amps;
-int my_amp;
-
-char *mods[]{"Cloner","Flanger","ChorusAnalog","UniVibe","Tremolator","Tremolo","Phaser","UniVibe"};
-int num_mods;
-int my_mod;
-
-
 void setup() {
   Serial.begin(115200);
   while (!Serial) {};
+  dlog.begin();
+  loop_events_start();
 
   delay(1000);
 
   splash_screen();
 
+  midi_feedback_resend(MIDI_OUT_ALL);
+  midi_clock_reset();
+  setup_midi_map();
   setup_midi();
 
-  Serial.println("Spark MIDI Captain");
-  Serial.println("==================");
+  DEBUG("Spark MIDI Captain");
+  DEBUG("==================");
 
   spark_state_tracker_start();
 
@@ -51,131 +59,159 @@ void setup() {
 
   my_preset = 0;
 
-  num_amps = sizeof(amps) / sizeof(char *);
-  my_amp = 0;
-  Serial.print("Number of amps in list ");
-  Serial.println(num_amps);
+  DEB("Models in the catalog ");
+  DEBUG(MODEL_COUNT);
+}
 
-  num_mods = sizeof(mods) / sizeof(char *);
-  my_mod = 0;
-  Serial.print("Number of mods in list ");
-  Serial.println(num_mods);
+// how long loop() can sleep before a timer needs it
+unsigned long loop_max_wait() {
+  unsigned long since, wait;
+
+#ifdef USB_HOST
+  // the USB Host Shield is serviced from update_midi() so it needs to be polled
+  return 1;
+#endif
+  wait = ble_midi_wait();
+  wait = min(wait, spark_upload_wait());
+  wait = min(wait, setlist_wait());
+  if (param_changes_pending > 0) {
+    since = millis() - param_flush_timer;
+    if (since >= param_flush_interval) return 0;
+    wait = min(wait, param_flush_interval - since);
+  }
+  return wait;
 }
 
-void loop() {
-  byte mi[3];
-  int midi_chan, midi_cmd;
-  bool onoff;
+bool loop_busy = false;
+
+// carry out a mapped action - val is the second data byte through the mapping's curve
+void midi_action(int action, float val) {
+  const spark_model *m;
+
+  switch (action) {
+    case ACT_GAIN:        change_amp_param(AMP_GAIN,   val); 
+                          DEB("Change amp gain ");
+                          DEBUG(val);
+                          break;
+    case ACT_MASTER:      change_amp_param(AMP_MASTER, val); 
+                          DEB("Change amp master volume ");
+                          DEBUG(val);
+                          break;         
+    case ACT_NOISEGATE:   change_noisegate_toggle();  
+                          DEBUG("Toggle noisegate");               
+                          break;
+    case ACT_COMP:        change_comp_toggle();                      
+                          DEBUG("Toggle comp");      
+                          break;
+    case ACT_DRIVE:       change_drive_toggle();   
+                          DEBUG("Toggle drive");                        
+                          break;
+    case ACT_MOD:         change_mod_toggle();     
+                          DEBUG("Toggle mod");                        
+                          break;
+    case ACT_DELAY:       change_delay_toggle();   
+                          DEBUG("Toggle delay");                        
+                          break; 
+    case ACT_REVERB:      change_reverb_toggle();                    
+                          DEBUG("Toggle reverb");      
+                          break; 
+    case ACT_PRESET_UP:   my_preset++;
+                          if (my_preset > max_preset) my_preset = 0;
+                          change_hardware_preset(my_preset);
+                          DEBUG("Preset up");
+                          break; 
+    case ACT_PRESET_DOWN: my_preset--;
+                          if (my_preset < 0)  my_preset = max_preset;
+                          change_hardware_preset(my_preset);
+                          DEBUG("Preset down");
+                          break;             
+    case ACT_AMP_NEXT:    m = model_next(3, presets[CUR_EDITING][current_input].effects[3].EffectName);
+                          if (m == NULL) break;
+                          change_model(m, true);
+                          DEB("Change amp model to ");
+                          DEBUG(m->name);
+                          break; 
+    case ACT_MOD_NEXT:    m = model_next(4, presets[CUR_EDITING][current_input].effects[4].EffectName);
+                          if (m == NULL) break;
+                          change_model(m, false);
+                          DEB("Change mod model to ");
+                          DEBUG(m->name);
+                          break; 
+    case ACT_MACRO_1:
+    case ACT_MACRO_2:
+    case ACT_MACRO_3:
+    case ACT_MACRO_4:     run_macro(action - ACT_MACRO_1);
+                          break;
+    case ACT_SETLIST_NEXT: setlist_go(setlist_pos + 1);
+                          break;
+    case ACT_SETLIST_PREV: setlist_go(setlist_pos - 1);
+                          break;
+    case ACT_PROFILE_NEXT: 
+                          // skip over any profile that won't load
+                          for (int p = 1; p < MIDI_MAP_PROFILES; p++)
+                            if (midi_map_select((midi_map_profile + p) % MIDI_MAP_PROFILES)) break;
+                          break;
+  }
+}
+
+// carry out the action for one MIDI message
+void process_midi(byte *mi) {
   char msg[20];
+  float val;
+  int action;
+
+  action = midi_map_lookup(mi, &val);
+  midi_action(action, val);
+
+  // Update display
+  #ifdef OLED_ON
+  sprintf(msg, "%2x %3d %3d", mi[0], mi[1], mi[2]);
+  show_message(msg, display_preset_num);
+  #endif
+}
+
+void loop() {
+  struct midi_event me;
   
-  
-  if (update_midi(mi)) {
-    midi_chan = (mi[0] & 0x0f) + 1;
-    midi_cmd = mi[0] & 0xf0;
-    onoff = (mi[2] == 127 ? true : false);
-
-    if (midi_cmd == 0xb0) {     
-      switch (mi[1]) {
-        case 10:   change_amp_param(AMP_GAIN,   mi[2]/127.0); 
-                   Serial.print("Change amp gain ");
-                   Serial.println(mi[2]/127.0);
-                   break;
-        case 11:   change_amp_param(AMP_MASTER, mi[2]/127.0); 
-                   Serial.print("Change amp master volume ");
-                   Serial.println(mi[2]/127.0);
-                   break;         
-        case 20:   change_noisegate_toggle();  
-                   Serial.println("Toggle noisegate");               
-                   break;
-        case 21:   change_comp_toggle();                      
-                   Serial.println("Toggle comp");      
-                   break;
-        case 22:   change_drive_toggle();   
-                   Serial.println("Toggle drive");                        
-                   break;
-        case 23:   change_mod_toggle();     
-                   Serial.println("Toggle mod");                        
-                   break;
-        case 80:   change_delay_toggle();   
-                   Serial.println("Toggle delay");                        
-                   break; 
-        case 81:   change_reverb_toggle();                    
-                   Serial.println("Toggle reverb");      
-                   break; 
-        case 24:   my_preset++;
-                   if (my_preset > max_preset) my_preset = 0;
-                   change_hardware_preset(my_preset);
-                   Serial.println("Preset up");
-                   break; 
-        case 84:   my_preset--;
-                   if (my_preset < 0)  my_preset = max_preset;
-                   change_hardware_preset(my_preset);
-                   Serial.println("Preset down");
-                   break;             
-        case 82:   my_amp++;
-                   if (my_amp >= num_amps)  my_amp = 0;
-                   change_amp_model(amps[my_amp]);
-                   Serial.print("Change amp model to ");
-                   Serial.println(amps[my_amp]);
-                   break; 
-        case 83:   my_mod++;
-                   if (my_mod >= num_mods)  my_mod = 0;
-                   change_mod_model(mods[my_mod]);
-                   Serial.print("Change mod model to ");
-                   Serial.println(mods[my_mod]);
-                   break; 
-      }
+  // sleep until there is MIDI or BLE data to handle, or a timer is due
+  // if there was something to do last time round there could be more waiting, so don't sleep
+  wait_for_loop_events(loop_busy ? 0 : loop_max_wait());
+  loop_busy = false;
+
+  // empty every MIDI source into the event queue, then act on all of it
+  // if the queue filled there is more MIDI waiting, so don't sleep next time
+  if (update_midi()) loop_busy = true;
+  while (next_midi_event(&me)) {
+    if (!midi_merge_accept(&me)) continue;
+    if (me.msg[0] >= 0xF8) {
+      midi_clock_message(me.msg[0], me.arrival);
+      continue;
     }
+    latency_dispatch(me.source, me.arrival);
+    TRACE(TR_MIDI_DISPATCH, me.msg[0] << 8 | me.msg[1]);
+    process_midi(me.msg);
+  }
 
-    if (midi_cmd == 0x80) {     
-      switch (mi[1]) {
-        case 57:   change_noisegate_toggle();  
-                   Serial.println("Toggle noisegate");               
-                   break;
-        case 59:   change_comp_toggle();                      
-                   Serial.println("Toggle comp");      
-                   break;
-        case 60:   change_drive_toggle();   
-                   Serial.println("Toggle drive");                        
-                   break;
-        case 62:   change_mod_toggle();     
-                   Serial.println("Toggle mod");                        
-                   break;
-        case 64:   change_delay_toggle();   
-                   Serial.println("Toggle delay");                        
-                   break; 
-        case 65:   change_reverb_toggle();                    
-                   Serial.println("Toggle reverb");      
-                   break; 
-        case 67:   my_preset++;
-                   if (my_preset > max_preset) my_preset = 0;
-                   change_hardware_preset(my_preset);
-                   Serial.println("Preset up");
-                   break; 
-        case 69:   my_preset--;
-                   if (my_preset < 0)  my_preset = max_preset;
-                   change_hardware_preset(my_preset);
-                   Serial.println("Preset down");
-                   break;        
-        case 71:   my_amp++;
-                   if (my_amp >= num_amps)  my_amp = 0;
-                   change_amp_model(amps[my_amp]);
-                   Serial.print("Change amp model to ");
-                   Serial.println(amps[my_amp]);
-                   break;      
-      }
-    }
+  // send any coalesced parameter changes
+  flush_param_changes();
 
-    // Update display
-    #ifdef OLED_ON
-    sprintf(msg, "%2x %3d %3d", mi[0], mi[1], mi[2]);
-    show_message(msg, display_preset_num);
-    #endif
-  }
+  // send the next block of a preset going over in the background, and keep the setlist's next preset loaded
+  update_spark_upload();
+  update_setlist();
+
+  // write out any messages queued to the amp and app this time round
+  flush_sparkIO();
+  latency_tick_end();
 
   if (update_spark_state()) {
-    Serial.print("Got message ");
-    Serial.println(cmdsub, HEX);
+    loop_busy = true;
+    DEB("Got message ");
+    DEBUG(cmdsub, HEX);
   }
 
+  // tell the controller about any effect or preset changes, from whoever made them
+  update_midi_feedback();
+
+  update_console();
+
 }
@@ -0,0 +1,68 @@
+#ifndef Trace_h
+#define Trace_h
+
+// Binary event trace
+//
+// TRACE(stage, arg) records the stage, the CPU cycle count and a 16 bit argument into a RAM ring.
+// It is cheap enough for the hot paths where a Serial.print would stall everything.
+// The 'trace' console command dumps the ring as hex and tools/trace_timeline.py turns that into a timeline.
+// The host tool reads the stage names from the enum below, so keep one stage per line.
+
+#define TRACE_ON
+
+#include "esp_cpu.h"
+
+#define TRACE_SIZE 1024     // must be a power of two
+
+enum trace_stage_t {
+  TR_MIDI_DIN,              // arg: status << 8 | data1
+  TR_MIDI_USB,              // arg: status << 8 | data1
+  TR_MIDI_BLE,              // arg: status << 8 | data1
+  TR_MIDI_DISPATCH,         // arg: status << 8 | data1
+  TR_QUEUE_FROM_SPARK,      // arg: packet length
+  TR_QUEUE_FROM_APP,        // arg: packet length
+  TR_PACKET_SPARK,          // arg: packet length taken off queue
+  TR_PACKET_APP,            // arg: packet length taken off queue
+  TR_GET_MESSAGE,           // arg: cmdsub
+  TR_QUEUE_TO_SPARK,        // arg: cmdsub
+  TR_QUEUE_TO_APP,          // arg: cmdsub
+  TR_FLUSH_BATCH,           // arg: block length
+  TR_SEND_SPARK,            // arg: block length
+  TR_SEND_APP,              // arg: block length
+  TR_STAGES
+};
+
+struct trace_entry {
+  uint32_t cycles;
+  uint16_t arg;
+  uint8_t  stage;
+  uint8_t  core;
+};
+
+trace_entry trace_ring[TRACE_SIZE];
+uint32_t trace_index = 0;
+bool trace_enabled = true;
+
+inline void trace(uint8_t stage, uint16_t arg) {
+  uint32_t i;
+  trace_entry *te;
+
+  if (!trace_enabled) return;
+  i = __atomic_fetch_add(&trace_index, 1, __ATOMIC_RELAXED) & (TRACE_SIZE - 1);
+  te = &trace_ring[i];
+  te->cycles = esp_cpu_get_cycle_count();
+  te->arg = arg;
+  te->stage = stage;
+  te->core = xPortGetCoreID();
+}
+
+#ifdef TRACE_ON
+  #define TRACE(stage, arg) trace((stage), (arg))
+#else
+  #define TRACE(stage, arg)
+#endif
+
+void trace_dump();
+void trace_clear();
+
+#endif
@@ -0,0 +1,37 @@
+#include "Trace.h"
+
+// Dump format - one entry per line with cycles, arg, stage and core in hex:
+//
+//   TRACE BEGIN <entries> <cpu MHz>
+//   cccccccc aaaa ss oo
+//   ...
+//   TRACE END
+
+void trace_dump() {
+  uint32_t first, last, i;
+  trace_entry *te;
+  char buf[30];
+
+  trace_enabled = false;
+
+  last = trace_index;
+  first = (last > TRACE_SIZE) ? last - TRACE_SIZE : 0;
+
+  Serial.print("TRACE BEGIN ");
+  Serial.print(last - first);
+  Serial.print(" ");
+  Serial.println(getCpuFrequencyMhz());
+
+  for (i = first; i < last; i++) {
+    te = &trace_ring[i & (TRACE_SIZE - 1)];
+    sprintf(buf, "%08lx %04x %02x %02x", (unsigned long) te->cycles, te->arg, te->stage, te->core);
+    Serial.println(buf);
+  }
+  Serial.println("TRACE END");
+
+  trace_enabled = true;
+}
+
+void trace_clear() {
+  trace_index = 0;
+}
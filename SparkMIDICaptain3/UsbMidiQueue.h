@@ -0,0 +1,72 @@
+#ifndef UsbMidiQueue_h
+#define UsbMidiQueue_h
+
+// Lock-free single producer, single consumer queue of USB-MIDI event packets
+//
+// The producer is midi_transfer_cb() in the USB host context, the consumer is update_midi() in loop().
+// Each side only writes its own index, and an entry is published by the release store of head after
+// it has been filled in, so the consumer never sees a half written packet and nothing needs a lock.
+// A full queue drops the new packet and counts it rather than overwriting one being read.
+//
+// Packets are kept whole - byte 0 is the cable number (high nibble) and the CIN (low nibble).
+
+#define USB_MIDI_QUEUE_SIZE 64      // must be a power of two
+
+struct usb_midi_packet {
+  uint8_t p[4];
+  uint8_t port;                     // which USB MIDI device
+  unsigned long arrival;            // micros() when the transfer completed
+};
+
+class UsbMidiQueue
+{
+  public:
+    UsbMidiQueue() { head = 0; tail = 0; pushed = 0; overflows = 0; high_water = 0; };
+
+    // producer side only
+    inline bool push(const uint8_t *p, int port, unsigned long arrival) {
+      uint32_t h, used;
+      usb_midi_packet *e;
+
+      h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+      used = h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+      if (used >= USB_MIDI_QUEUE_SIZE) {
+        overflows++;
+        return false;
+      }
+      e = &q[h & (USB_MIDI_QUEUE_SIZE - 1)];
+      e->p[0] = p[0];
+      e->p[1] = p[1];
+      e->p[2] = p[2];
+      e->p[3] = p[3];
+      e->port = port;
+      e->arrival = arrival;
+      __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+      pushed++;
+      if (used + 1 > high_water) high_water = used + 1;
+      return true;
+    };
+
+    // consumer side only
+    inline bool pop(usb_midi_packet *out) {
+      uint32_t t;
+
+      t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+      if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) return false;
+      *out = q[t & (USB_MIDI_QUEUE_SIZE - 1)];
+      __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+      return true;
+    };
+
+    // counters are only written by the producer
+    unsigned long pushed;
+    unsigned long overflows;
+    uint32_t high_water;
+
+  private:
+    usb_midi_packet q[USB_MIDI_QUEUE_SIZE];
+    uint32_t head;                  // next to write, only changed by the producer
+    uint32_t tail;                  // next to read, only changed by the consumer
+};
+
+#endif
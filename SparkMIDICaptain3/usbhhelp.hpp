@@ -22,24 +22,38 @@
  * SOFTWARE.
  */
 
-const TickType_t HOST_EVENT_TIMEOUT = 1;
-const TickType_t CLIENT_EVENT_TIMEOUT = 1;
+// The host library and the client events are each handled by their own task, which blocks until there
+// is something to do - so nothing USB has to be polled from loop(). The transfer callbacks, including
+// midi_transfer_cb(), run in the client task.
+#define USB_LIB_TASK_PRIORITY    2
+#define USB_CLIENT_TASK_PRIORITY 3
+#define USB_TASK_STACK           4096
 
+TaskHandle_t usb_lib_task_handle;
+TaskHandle_t usb_client_task_handle;
+
+// Every device that turns up - through a hub there can be several - is opened and its handle passed to
+// the enumeration callback. The gone callback is told when one is unplugged.
 usb_host_client_handle_t Client_Handle;
-usb_device_handle_t Device_Handle;
-typedef void (*usb_host_enum_cb_t)(const usb_config_desc_t *config_desc);
+typedef void (*usb_host_enum_cb_t)(usb_device_handle_t dev_hdl, const usb_config_desc_t *config_desc);
+typedef void (*usb_host_gone_cb_t)(usb_device_handle_t dev_hdl);
 static usb_host_enum_cb_t _USB_host_enumerate;
+static usb_host_gone_cb_t _USB_host_gone;
 
 void _client_event_callback(const usb_host_client_event_msg_t *event_msg, void *arg)
 {
   esp_err_t err;
+  usb_device_handle_t Device_Handle;
   switch (event_msg->event)
   {
     /**< A new device has been enumerated and added to the USB Host Library */
     case USB_HOST_CLIENT_EVENT_NEW_DEV:
       ESP_LOGI("", "New device address: %d", event_msg->new_dev.address);
       err = usb_host_device_open(Client_Handle, event_msg->new_dev.address, &Device_Handle);
-      if (err != ESP_OK) ESP_LOGI("", "usb_host_device_open: %x", err);
+      if (err != ESP_OK) {
+        ESP_LOGI("", "usb_host_device_open: %x", err);
+        break;
+      }
 
       usb_device_info_t dev_info;
       err = usb_host_device_info(Device_Handle, &dev_info);
@@ -56,11 +70,12 @@ void _client_event_callback(const usb_host_client_event_msg_t *event_msg, void *
       const usb_config_desc_t *config_desc;
       err = usb_host_get_active_config_descriptor(Device_Handle, &config_desc);
       if (err != ESP_OK) ESP_LOGI("", "usb_host_get_config_desc: %x", err);
-      (*_USB_host_enumerate)(config_desc);
+      (*_USB_host_enumerate)(Device_Handle, config_desc);
       break;
     /**< A device opened by the client is now gone */
     case USB_HOST_CLIENT_EVENT_DEV_GONE:
       ESP_LOGI("", "Device Gone handle: %x", event_msg->dev_gone.dev_hdl);
+      (*_USB_host_gone)(event_msg->dev_gone.dev_hdl);
       break;
     default:
       ESP_LOGI("", "Unknown value %d", event_msg->event);
@@ -70,7 +85,37 @@ void _client_event_callback(const usb_host_client_event_msg_t *event_msg, void *
 
 // Reference: esp-idf/examples/peripherals/usb/host/usb_host_lib/main/usb_host_lib_main.c
 
-void usbh_setup(usb_host_enum_cb_t enumeration_cb)
+void usbh_lib_task(void *arg)
+{
+  uint32_t event_flags;
+
+  while (true) {
+    esp_err_t err = usb_host_lib_handle_events(portMAX_DELAY, &event_flags);
+    if (err == ESP_OK) {
+      if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
+        ESP_LOGI("", "No more clients");
+      }
+      if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) {
+        ESP_LOGI("", "No more devices");
+      }
+    }
+    else if (err != ESP_ERR_TIMEOUT) {
+      ESP_LOGI("", "usb_host_lib_handle_events: %x flags: %x", err, event_flags);
+    }
+  }
+}
+
+void usbh_client_task(void *arg)
+{
+  while (true) {
+    esp_err_t err = usb_host_client_handle_events(Client_Handle, portMAX_DELAY);
+    if ((err != ESP_OK) && (err != ESP_ERR_TIMEOUT)) {
+      ESP_LOGI("", "usb_host_client_handle_events: %x", err);
+    }
+  }
+}
+
+void usbh_setup(usb_host_enum_cb_t enumeration_cb, usb_host_gone_cb_t gone_cb)
 {
   const usb_host_config_t config = {
     .intr_flags = ESP_INTR_FLAG_LEVEL1,
@@ -80,7 +125,7 @@ void usbh_setup(usb_host_enum_cb_t enumeration_cb)
 
   const usb_host_client_config_t client_config = {
     .is_synchronous = false,
-    .max_num_event_msg = 5,
+    .max_num_event_msg = 5 + 2 * USB_MIDI_MAX_DEVICES,
     .async = {
         .client_event_callback = _client_event_callback,
         .callback_arg = Client_Handle
@@ -90,34 +135,8 @@ void usbh_setup(usb_host_enum_cb_t enumeration_cb)
   ESP_LOGI("", "usb_host_client_register: %x", err);
 
   _USB_host_enumerate = enumeration_cb;
-}
-
-void usbh_task(void)
-{
-  uint32_t event_flags;
-  static bool all_clients_gone = false;
-  static bool all_dev_free = false;
-
-
-  esp_err_t err = usb_host_lib_handle_events(HOST_EVENT_TIMEOUT, &event_flags);
-  if (err == ESP_OK) {
-    if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
-      ESP_LOGI("", "No more clients");
-      all_clients_gone = true;
-    }
-    if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) {
-      ESP_LOGI("", "No more devices");
-      all_dev_free = true;
-    }
-  }
-  else {
-    if (err != ESP_ERR_TIMEOUT) {
-      ESP_LOGI("", "usb_host_lib_handle_events: %x flags: %x", err, event_flags);
-    }
-  }
+  _USB_host_gone = gone_cb;
 
-  err = usb_host_client_handle_events(Client_Handle, CLIENT_EVENT_TIMEOUT);
-  if ((err != ESP_OK) && (err != ESP_ERR_TIMEOUT)) {
-    ESP_LOGI("", "usb_host_client_handle_events: %x", err);
-  }
-}
\ No newline at end of file
+  xTaskCreatePinnedToCore(usbh_lib_task, "usb_lib", USB_TASK_STACK, NULL, USB_LIB_TASK_PRIORITY, &usb_lib_task_handle, ARDUINO_RUNNING_CORE);
+  xTaskCreatePinnedToCore(usbh_client_task, "usb_client", USB_TASK_STACK, NULL, USB_CLIENT_TASK_PRIORITY, &usb_client_task_handle, ARDUINO_RUNNING_CORE);
+}
@@ -0,0 +1,50 @@
+// MIDIParser throughput on a mixed stream - on the host, so only good for comparing one version with another
+
+#include "midi_host.h"
+
+#include <chrono>
+#include <random>
+
+int main(int argc, char **argv) {
+  std::vector<uint8_t> stream;
+  std::mt19937 rng(1);
+  MIDIParser parser;
+  uint8_t msg[3];
+  unsigned long messages;
+  int size, i, n, rounds;
+
+  size = (argc > 1) ? atoi(argv[1]) : 4000000;
+  rounds = 5;
+
+  // a pedal sweep with running status, notes, clock and now and then a SysEx
+  while ((int) stream.size() < size) {
+    switch (rng() % 8) {
+      case 0:  stream.insert(stream.end(), {0x90, (uint8_t) (rng() & 0x7f), 0x64, 0x3C, 0x00}); break;
+      case 1:  stream.push_back(0xF8); break;
+      case 2:  stream.insert(stream.end(), {0xC0, (uint8_t) (rng() & 0x7f)}); break;
+      case 3:  if (rng() % 16 == 0) {
+                 stream.push_back(0xF0);
+                 for (n = 0; n < 20; n++) stream.push_back(rng() & 0x7f);
+                 stream.push_back(0xF7);
+               }
+               break;
+      default: stream.insert(stream.end(), {0xB0, 0x07, (uint8_t) (rng() & 0x7f)});
+               for (n = rng() % 8; n > 0; n--) stream.insert(stream.end(), {0x07, (uint8_t) (rng() & 0x7f)});
+               break;
+    }
+  }
+
+  double best = 1e30;
+  messages = 0;
+  for (n = 0; n < rounds; n++) {
+    auto start = std::chrono::steady_clock::now();
+    messages = 0;
+    for (i = 0; i < (int) stream.size(); i++)
+      if (parser.parse(stream[i], msg)) messages++;
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, s);
+  }
+  printf("%zu bytes, %lu messages: best of %d %.2f ms, %.1f MB/s, %.1f M messages/s\n",
+         stream.size(), messages, rounds, best * 1000, stream.size() / best / 1e6, messages / best / 1e6);
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef ble_host_h
+#define ble_host_h
+
+// The sketch's SparkComms.ino built on the host, against the fake NimBLE in host/NimBLEDevice.h
+// Only the connect code is meant to be run - the packet function it calls is empty here.
+
+#include "Arduino.h"
+
+#define DEB(...)
+#define DEBUG(...)
+
+#include "Trace.h"
+#include "LoopEvents.h"
+
+void loop_signal(EventBits_t bits) {}
+
+#include "SparkComms.h"
+
+void new_packet_from_data(struct packet_data *pd, uint8_t *data, int length) {}
+
+#include "SparkComms.ino"
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef check_h
+#define check_h
+
+// A test is a program that returns non-zero if any CHECK failed
+
+#include <cstdio>
+
+int check_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      check_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long _a = (long) (a), _b = (long) (b); \
+    if (_a != _b) { \
+      printf("%s:%d: CHECK failed: %s == %s (%ld against %ld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+      check_failures++; \
+    } \
+  } while (0)
+
+inline int check_result() {
+  if (check_failures > 0) printf("%d check%s failed\n", check_failures, check_failures == 1 ? "" : "s");
+  return check_failures > 0 ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef corpus_h
+#define corpus_h
+
+// The text files in data/ - each line is some bytes in hex, then -> and the messages they must give.
+// # starts a comment, and xx*n is the byte xx n times.
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct corpus_line {
+  int line;
+  std::string in;
+  std::string want;
+};
+
+std::string trim(const std::string &s) {
+  size_t a = s.find_first_not_of(" \t\r"), b = s.find_last_not_of(" \t\r");
+  return (a == std::string::npos) ? "" : s.substr(a, b - a + 1);
+}
+
+std::vector<uint8_t> corpus_bytes(const std::string &text) {
+  std::vector<uint8_t> out;
+  std::istringstream in(text);
+  std::string tok;
+  size_t star;
+  int n;
+
+  while (in >> tok) {
+    star = tok.find('*');
+    n = (star == std::string::npos) ? 1 : atoi(tok.c_str() + star + 1);
+    while (n-- > 0) out.push_back(strtol(tok.substr(0, star).c_str(), NULL, 16));
+  }
+  return out;
+}
+
+// false if the file can't be read or a line has no ->
+bool read_corpus(const char *path, std::vector<corpus_line> &lines) {
+  std::ifstream f(path);
+  std::string text;
+  size_t arrow;
+  int n;
+
+  if (!f) {
+    printf("can't open %s\n", path);
+    return false;
+  }
+  for (n = 1; std::getline(f, text); n++) {
+    text = trim(text);
+    if (text.empty() || text[0] == '#') continue;
+    arrow = text.find("->");
+    if (arrow == std::string::npos) {
+      printf("%s line %d: no ->\n", path, n);
+      return false;
+    }
+    lines.push_back({n, trim(text.substr(0, arrow)), trim(text.substr(arrow + 2))});
+  }
+  return true;
+}
+
+// a message as corpus text, eg B00710
+std::string midi_text(const uint8_t *msg, int len) {
+  char text[8];
+
+  if (len == 1)      snprintf(text, sizeof(text), "%02X", msg[0]);
+  else if (len == 2) snprintf(text, sizeof(text), "%02X%02X", msg[0], msg[1]);
+  else               snprintf(text, sizeof(text), "%02X%02X%02X", msg[0], msg[1], msg[2]);
+  return text;
+}
+
+void corpus_append(std::string &out, const std::string &msg) {
+  if (!out.empty()) out += " ";
+  out += msg;
+}
+
+bool corpus_check(const char *path, const corpus_line &l, const std::string &got) {
+  if (got == l.want) return true;
+  printf("%s line %d: %s\n  want: %s\n  got:  %s\n", path, l.line, l.in.c_str(), l.want.c_str(), got.c_str());
+  return false;
+}
+
+#endif
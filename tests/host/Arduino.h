@@ -0,0 +1,199 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+// Just enough of Arduino-ESP32 and FreeRTOS to build the sketch's MIDI code on a PC
+//
+// Time only moves when a test moves it (host_us), so runs are repeatable. Queues are fixed size copies like
+// the FreeRTOS ones, behind a mutex so two threads can use them. A wait on a full or empty queue can't be
+// done for real in one thread, so it moves the clock on by the timeout and gives up.
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+typedef uint8_t byte;
+
+// esp_err.h and esp_log.h, which Arduino-ESP32 brings in
+typedef int esp_err_t;
+#define ESP_OK              0
+#define ESP_FAIL            -1
+#define ESP_ERR_NO_MEM      0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_TIMEOUT     0x107
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+#define ESP_LOGI(tag, ...) do {} while (0)
+
+#define HEX 16
+#define DEC 10
+
+unsigned long host_us = 0;
+
+inline unsigned long micros() { return host_us; }
+inline unsigned long millis() { return host_us / 1000; }
+inline void delay(unsigned long ms) { host_us += ms * 1000; }
+
+using std::min;
+using std::max;
+
+struct HostSerial {
+  void print(const char *s)              { fputs(s, stdout); }
+  void print(char c)                     { putchar(c); }
+  void print(long n, int base = DEC)     { printf(base == HEX ? "%lx" : "%ld", n); }
+  void print(unsigned long n, int base = DEC) { printf(base == HEX ? "%lx" : "%lu", n); }
+  void print(int n, int base = DEC)      { print((long) n, base); }
+  void print(unsigned int n, int base = DEC) { print((unsigned long) n, base); }
+  void print(double f, int digits = 2)   { printf("%.*f", digits, f); }
+  template <typename T> void println(T v) { print(v); putchar('\n'); }
+  template <typename T> void println(T v, int base) { print(v, base); putchar('\n'); }
+  void println()                         { putchar('\n'); }
+};
+
+HostSerial Serial;
+
+// Arduino's String, only as far as the sketch uses it
+class String {
+  public:
+    String(const char *s = "") : s(s) {}
+    String(const std::string &s) : s(s) {}
+    const char *c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.size(); }
+  private:
+    std::string s;
+};
+
+// FreeRTOS
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef void *EventGroupHandle_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+#define portMAX_DELAY 0xffffffffUL
+#define ARDUINO_RUNNING_CORE 1
+
+#define BIT0 0x01
+#define BIT1 0x02
+#define BIT2 0x04
+#define BIT3 0x08
+#define BIT4 0x10
+#define BIT5 0x20
+#define BIT6 0x40
+#define BIT7 0x80
+
+struct host_queue {
+  std::mutex lock;
+  std::vector<uint8_t> buf;
+  size_t item_size;
+  size_t length;
+  size_t head;
+  size_t count;
+};
+typedef host_queue *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  QueueHandle_t q = new host_queue;
+  q->buf.resize(length * item_size);
+  q->item_size = item_size;
+  q->length = length;
+  q->head = 0;
+  q->count = 0;
+  return q;
+}
+
+inline void host_queue_wait(TickType_t ticks) {
+  if (ticks != portMAX_DELAY) host_us += ticks * 1000UL;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) {
+  {
+    std::lock_guard<std::mutex> g(q->lock);
+    if (q->count < q->length) {
+      memcpy(&q->buf[((q->head + q->count) % q->length) * q->item_size], item, q->item_size);
+      q->count++;
+      return pdTRUE;
+    }
+  }
+  host_queue_wait(wait);
+  return pdFALSE;
+}
+
+inline BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait) {
+  {
+    std::lock_guard<std::mutex> g(q->lock);
+    if (q->count > 0) {
+      memcpy(item, &q->buf[q->head * q->item_size], q->item_size);
+      return pdTRUE;
+    }
+  }
+  host_queue_wait(wait);
+  return pdFALSE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) {
+  {
+    std::lock_guard<std::mutex> g(q->lock);
+    if (q->count > 0) {
+      memcpy(item, &q->buf[q->head * q->item_size], q->item_size);
+      q->head = (q->head + 1) % q->length;
+      q->count--;
+      return pdTRUE;
+    }
+  }
+  host_queue_wait(wait);
+  return pdFALSE;
+}
+
+inline BaseType_t xQueueReset(QueueHandle_t q) {
+  std::lock_guard<std::mutex> g(q->lock);
+  q->head = 0;
+  q->count = 0;
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  std::lock_guard<std::mutex> g(q->lock);
+  return q->count;
+}
+
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+  std::lock_guard<std::mutex> g(q->lock);
+  return q->length - q->count;
+}
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define taskENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux)
+
+// one thread, so a mutex is always free and a notification has no task to wake
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { static int mutex; return &mutex; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) { return pdTRUE; }
+inline void xTaskNotifyGive(TaskHandle_t task) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) { host_us += ticks * 1000UL; return 0; }
+
+// tasks are never started on the host - a test calls the task's work itself
+inline BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *param,
+                                          UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  if (handle != NULL) *handle = NULL;
+  return pdTRUE;
+}
+
+#define tskIDLE_PRIORITY 0
+
+inline void vTaskDelay(TickType_t ticks) { host_us += ticks * 1000UL; }
+inline BaseType_t xPortGetCoreID() { return 1; }
+
+#endif
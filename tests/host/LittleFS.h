@@ -0,0 +1,37 @@
+#ifndef LittleFS_h
+#define LittleFS_h
+
+// LittleFS as a map of file names to their contents, filled in by the test
+
+#include <map>
+
+std::map<std::string, std::string> host_fs;
+
+class File {
+  public:
+    File(const std::string *data = NULL) : data(data), pos(0) {}
+    operator bool() const { return data != NULL; }
+    int available() { return data == NULL ? 0 : data->size() - pos; }
+    int read() { return available() ? (uint8_t) (*data)[pos++] : -1; }
+    size_t readBytesUntil(char term, char *buf, size_t length) {
+      size_t n = 0;
+      int c;
+
+      while (n < length && (c = read()) >= 0 && c != term) buf[n++] = c;
+      return n;
+    }
+    void close() { data = NULL; }
+
+  private:
+    const std::string *data;
+    size_t pos;
+};
+
+struct HostLittleFS {
+  bool begin(bool format_on_fail) { return true; }
+  File open(const char *path, const char *mode) { return host_fs.count(path) ? File(&host_fs[path]) : File(); }
+};
+
+HostLittleFS LittleFS;
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef NimBLEDevice_h
+#define NimBLEDevice_h
+
+// A fake of NimBLE-Arduino with a simulated advertising environment, for the connect code in SparkComms.ino
+//
+// A test fills host_ble_env with the devices around, each with the times (ms) its advertisements are heard.
+// A running scan hands them to the scan callback as the clock passes them - each time isScanning() is
+// asked, which scan_for_devices() does between its delay()s. Connecting takes host_ble_connect_ms to a
+// device that is switched on, and the client's connect timeout to one that isn't. A deleted client is kept,
+// so using it afterwards is counted in host_ble_deleted_use instead of crashing.
+
+#include <map>
+
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+struct host_ble_device {
+  std::string name;
+  std::string service;
+  std::string address;
+  unsigned long on_ms;                    // switched on at
+  std::vector<unsigned long> adverts;     // when its advertisements are heard, in order
+  mutable int subscribe_failures;         // how many subscribes fail before one works
+};
+
+std::vector<host_ble_device> host_ble_env;
+unsigned long host_ble_connect_ms = 50;
+int host_ble_deleted_use = 0;             // calls on a client after deleteClient()
+int host_ble_connect_while_scanning = 0;
+int host_ble_clients = 0;                 // created and not deleted
+
+class NimBLEUUID {
+  public:
+    NimBLEUUID() {}
+    NimBLEUUID(const char *s) : uuid(s) {}
+    NimBLEUUID(uint16_t u) { char s[8]; snprintf(s, sizeof(s), "%04x", u); uuid = s; }
+    bool operator==(const NimBLEUUID &o) const { return uuid == o.uuid; }
+    std::string uuid;
+};
+
+class NimBLEAddress {
+  public:
+    NimBLEAddress() : type(0) {}
+    NimBLEAddress(const std::string &a, uint8_t type) : addr(a), type(type) {}
+    std::string toString() const { return addr; }
+    uint8_t getType() const { return type; }
+    bool operator==(const NimBLEAddress &o) const { return addr == o.addr; }
+  private:
+    std::string addr;
+    uint8_t type;
+};
+
+struct NimBLEConnInfo {};
+
+namespace NIMBLE_PROPERTY {
+  const uint32_t READ = 0x02, WRITE_NR = 0x04, WRITE = 0x08, NOTIFY = 0x10;
+}
+
+class NimBLEAdvertisedDevice {
+  public:
+    NimBLEAdvertisedDevice(const host_ble_device *d) : d(d) {}
+    bool isAdvertisingService(const NimBLEUUID &u) const { return d->service == u.uuid; }
+    std::string getName() const { return d->name; }
+    NimBLEAddress getAddress() const { return NimBLEAddress(d->address, 0); }
+  private:
+    const host_ble_device *d;
+};
+
+class NimBLEScanCallbacks {
+  public:
+    virtual ~NimBLEScanCallbacks() {}
+    virtual void onResult(const NimBLEAdvertisedDevice *dev) {}
+};
+
+class NimBLEScanResults {};
+
+class NimBLEScan {
+  public:
+    void setInterval(uint16_t ms) {}
+    void setWindow(uint16_t ms) {}
+    void setActiveScan(bool active) {}
+    void setScanCallbacks(NimBLEScanCallbacks *cb, bool want_duplicates = false) { callbacks = cb; }
+
+    bool start(uint32_t duration_ms, bool is_continue = false, bool restart = true) {
+      scanning = true;
+      heard_to = millis();
+      end = millis() + duration_ms;
+      next.assign(host_ble_env.size(), 0);
+      return true;
+    }
+
+    // hand over everything heard since last time, in time order
+    bool isScanning() {
+      unsigned long now = millis();
+      std::vector<std::pair<unsigned long, const host_ble_device *>> heard;
+      size_t i;
+
+      if (!scanning) return false;
+      if (now > end) now = end;
+      for (i = 0; i < host_ble_env.size(); i++) {
+        const host_ble_device &d = host_ble_env[i];
+        for (; next[i] < d.adverts.size() && d.adverts[next[i]] < now; next[i]++)
+          if (d.adverts[next[i]] >= heard_to) heard.push_back({d.adverts[next[i]], &d});
+      }
+      std::sort(heard.begin(), heard.end());
+      for (auto &h : heard) {
+        NimBLEAdvertisedDevice dev(h.second);
+        if (callbacks != NULL) callbacks->onResult(&dev);
+      }
+      heard_to = now;
+      if (now >= end) scanning = false;
+      return scanning;
+    }
+
+    bool stop() { scanning = false; return true; }
+    void clearResults() {}
+
+    bool scanning = false;
+
+  private:
+    NimBLEScanCallbacks *callbacks = NULL;
+    unsigned long heard_to = 0;
+    unsigned long end = 0;
+    std::vector<size_t> next;             // each device's next advertisement
+};
+
+NimBLEScan host_ble_scan;
+
+typedef void (*notify_callback)(class NimBLERemoteCharacteristic *c, uint8_t *data, size_t len, bool is_notify);
+
+class NimBLERemoteDescriptor {
+  public:
+    bool writeValue(const uint8_t *data, size_t len, bool response = false) { return true; }
+};
+
+class NimBLERemoteCharacteristic {
+  public:
+    NimBLERemoteCharacteristic(const host_ble_device *d) : d(d) {}
+    bool canNotify() { return true; }
+    bool subscribe(bool notifications, notify_callback cb, bool response = true) {
+      if (d->subscribe_failures == 0) return true;
+      d->subscribe_failures--;
+      return false;
+    }
+    bool writeValue(const uint8_t *data, size_t len, bool response = false) { return true; }
+    NimBLERemoteDescriptor *getDescriptor(const NimBLEUUID &u) { return NULL; }
+  private:
+    const host_ble_device *d;
+};
+
+class NimBLERemoteService {
+  public:
+    NimBLERemoteService(const host_ble_device *d) : d(d) {}
+    NimBLERemoteCharacteristic *getCharacteristic(const char *uuid) { return new NimBLERemoteCharacteristic(d); }
+  private:
+    const host_ble_device *d;
+};
+
+class NimBLEClient;
+
+class NimBLEClientCallbacks {
+  public:
+    virtual ~NimBLEClientCallbacks() {}
+    virtual void onConnect(NimBLEClient *client) {}
+    virtual void onDisconnect(NimBLEClient *client, int reason) {}
+};
+
+class NimBLEClient {
+  public:
+    void setClientCallbacks(NimBLEClientCallbacks *cb) { use(); callbacks = cb; }
+    void setConnectTimeout(uint32_t ms) { use(); timeout = ms; }
+
+    bool connect(const NimBLEAddress &a) {
+      use();
+      if (host_ble_scan.scanning) host_ble_connect_while_scanning++;
+      for (const host_ble_device &d : host_ble_env) {
+        if (d.address == a.toString() && millis() >= d.on_ms) {
+          host_us += host_ble_connect_ms * 1000;
+          device = &d;
+          if (callbacks != NULL) callbacks->onConnect(this);
+          return true;
+        }
+      }
+      host_us += timeout * 1000UL;
+      return false;
+    }
+
+    bool isConnected() { use(); return device != NULL; }
+    NimBLERemoteService *getService(const NimBLEUUID &u) {
+      use();
+      return (device != NULL && device->service == u.uuid) ? new NimBLERemoteService(device) : NULL;
+    }
+    void setMTU(uint16_t mtu) { use(); }
+    int getRssi() { use(); return -50; }
+
+    bool deleted = false;
+    const host_ble_device *device = NULL;
+
+  private:
+    void use() { if (deleted) host_ble_deleted_use++; }
+    NimBLEClientCallbacks *callbacks = NULL;
+    uint32_t timeout = 30000;
+};
+
+class NimBLECharacteristic;
+
+class NimBLECharacteristicCallbacks {
+  public:
+    virtual ~NimBLECharacteristicCallbacks() {}
+    virtual void onWrite(NimBLECharacteristic *c, NimBLEConnInfo &info) {}
+};
+
+class NimBLECharacteristic {
+  public:
+    void setCallbacks(NimBLECharacteristicCallbacks *cb) {}
+    std::string getValue() { return ""; }
+    bool notify(const uint8_t *data, size_t len, uint16_t handle) { return true; }
+};
+
+class NimBLEService {
+  public:
+    NimBLEService(const char *uuid) : uuid(uuid) {}
+    NimBLECharacteristic *createCharacteristic(const char *uuid, uint32_t properties) { return new NimBLECharacteristic(); }
+    bool start() { return true; }
+    NimBLEUUID getUUID() { return uuid; }
+  private:
+    NimBLEUUID uuid;
+};
+
+class NimBLEServer;
+
+class NimBLEServerCallbacks {
+  public:
+    virtual ~NimBLEServerCallbacks() {}
+    virtual void onConnect(NimBLEServer *server, NimBLEConnInfo &info) {}
+    virtual void onDisconnect(NimBLEServer *server, NimBLEConnInfo &info, int reason) {}
+};
+
+class NimBLEServer {
+  public:
+    void setCallbacks(NimBLEServerCallbacks *cb) {}
+    NimBLEService *createService(const char *uuid) { return new NimBLEService(uuid); }
+    void advertiseOnDisconnect(bool on) {}
+    void start() {}
+    int getConnectedCount() { return 0; }
+};
+
+class NimBLEAdvertising {
+  public:
+    bool addServiceUUID(const NimBLEUUID &u) { return true; }
+    bool enableScanResponse(bool on) { return true; }
+    bool setName(const std::string &name) { return true; }
+    bool start() { return true; }
+};
+
+class NimBLEDevice {
+  public:
+    static bool init(const std::string &name) { return true; }
+    static bool setMTU(uint16_t mtu) { return true; }
+    static NimBLEScan *getScan() { return &host_ble_scan; }
+    static NimBLEServer *createServer() { return new NimBLEServer(); }
+    static NimBLEAdvertising *getAdvertising() { static NimBLEAdvertising a; return &a; }
+    static NimBLEClient *createClient() { host_ble_clients++; return new NimBLEClient(); }
+    static bool deleteClient(NimBLEClient *c) {
+      if (c == NULL || c->deleted) return false;
+      c->deleted = true;
+      host_ble_clients--;
+      return true;
+    }
+};
+
+// the Arduino BLE names NimBLE-Arduino maps onto its own
+using BLEDevice = NimBLEDevice;
+using BLEUUID = NimBLEUUID;
+using BLEAddress = NimBLEAddress;
+using BLEScan = NimBLEScan;
+using BLEScanResults = NimBLEScanResults;
+using BLEAdvertisedDevice = NimBLEAdvertisedDevice;
+using BLEClient = NimBLEClient;
+using BLEClientCallbacks = NimBLEClientCallbacks;
+using BLERemoteService = NimBLERemoteService;
+using BLERemoteCharacteristic = NimBLERemoteCharacteristic;
+using BLERemoteDescriptor = NimBLERemoteDescriptor;
+using BLEServer = NimBLEServer;
+using BLEServerCallbacks = NimBLEServerCallbacks;
+using BLEService = NimBLEService;
+using BLECharacteristic = NimBLECharacteristic;
+using BLECharacteristicCallbacks = NimBLECharacteristicCallbacks;
+using BLEAdvertising = NimBLEAdvertising;
+
+#endif
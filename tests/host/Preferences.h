@@ -0,0 +1,31 @@
+#ifndef Preferences_h
+#define Preferences_h
+
+// NVS as a map that lasts as long as the test, so a second boot sees what the first one saved
+
+#include <map>
+
+std::map<std::string, std::map<std::string, std::string>> host_nvs;
+
+class Preferences {
+  public:
+    bool begin(const char *name, bool read_only = false) { ns = name; return true; }
+    void end() {}
+    bool clear() { host_nvs[ns].clear(); return true; }
+
+    String getString(const char *key, const String &def = String()) {
+      auto &m = host_nvs[ns];
+      return m.count(key) ? String(m[key]) : def;
+    }
+    uint8_t getUChar(const char *key, uint8_t def = 0) {
+      auto &m = host_nvs[ns];
+      return m.count(key) ? (uint8_t) atoi(m[key].c_str()) : def;
+    }
+    size_t putString(const char *key, const char *value) { host_nvs[ns][key] = value; return strlen(value); }
+    size_t putUChar(const char *key, uint8_t value) { host_nvs[ns][key] = std::to_string(value); return 1; }
+
+  private:
+    std::string ns;
+};
+
+#endif
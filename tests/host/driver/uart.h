@@ -0,0 +1,78 @@
+#ifndef uart_h
+#define uart_h
+
+// A fake of the IDF UART driver for DIN MIDI - host_uart_receive() puts bytes in the RX buffer, as the
+// driver's interrupt would, and uart_write_bytes() keeps what is sent in host_uart_tx
+
+#include <deque>
+
+typedef int uart_port_t;
+#define UART_NUM_1 1
+#define UART_PIN_NO_CHANGE -1
+
+enum uart_word_length_t {UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS};
+enum uart_parity_t {UART_PARITY_DISABLE, UART_PARITY_EVEN, UART_PARITY_ODD};
+enum uart_stop_bits_t {UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5, UART_STOP_BITS_2};
+enum uart_hw_flowcontrol_t {UART_HW_FLOWCTRL_DISABLE};
+enum uart_sclk_t {UART_SCLK_DEFAULT};
+enum uart_event_type_t {UART_DATA, UART_BREAK, UART_BUFFER_FULL, UART_FIFO_OVF, UART_FRAME_ERR, UART_PARITY_ERR};
+
+struct uart_config_t {
+  int baud_rate;
+  uart_word_length_t data_bits;
+  uart_parity_t parity;
+  uart_stop_bits_t stop_bits;
+  uart_hw_flowcontrol_t flow_ctrl;
+  uint8_t rx_flow_ctrl_thresh;
+  uart_sclk_t source_clk;
+};
+
+struct uart_event_t {
+  uart_event_type_t type;
+  size_t size;
+};
+
+std::deque<uint8_t> host_uart_rx;
+std::vector<uint8_t> host_uart_tx;
+
+inline void host_uart_receive(const uint8_t *buf, int len) {
+  host_uart_rx.insert(host_uart_rx.end(), buf, buf + len);
+}
+
+inline esp_err_t uart_driver_install(uart_port_t port, int rx_size, int tx_size, int queue_size,
+                                     QueueHandle_t *queue, int flags) {
+  *queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+  return ESP_OK;
+}
+
+inline esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config) { return ESP_OK; }
+inline esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts) { return ESP_OK; }
+inline esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold) { return ESP_OK; }
+inline esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t timeout) { return ESP_OK; }
+
+inline esp_err_t uart_flush_input(uart_port_t port) {
+  host_uart_rx.clear();
+  return ESP_OK;
+}
+
+inline esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size) {
+  *size = host_uart_rx.size();
+  return ESP_OK;
+}
+
+inline int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t wait) {
+  uint32_t n;
+
+  for (n = 0; n < length && !host_uart_rx.empty(); n++) {
+    ((uint8_t *) buf)[n] = host_uart_rx.front();
+    host_uart_rx.pop_front();
+  }
+  return n;
+}
+
+inline int uart_write_bytes(uart_port_t port, const void *buf, size_t len) {
+  host_uart_tx.insert(host_uart_tx.end(), (const uint8_t *) buf, (const uint8_t *) buf + len);
+  return len;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef esp_cpu_h
+#define esp_cpu_h
+
+// Trace.h timestamps with the cycle count - on the host that is just the test clock
+
+inline uint32_t esp_cpu_get_cycle_count() { return (uint32_t) micros() * 240; }
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef usb_host_h
+#define usb_host_h
+
+// A fake of the IDF USB host library, for the USB S3 MIDI code
+//
+// There are no tasks: a test plays the client task by calling host_usb_plug() and host_usb_unplug(), which
+// send the client callback its events, and host_usb_in() and host_usb_out_done(), which complete submitted
+// transfers and call their callbacks. Flushing an endpoint calls back its transfers as cancelled, as the
+// library does once the client task runs.
+
+#include <vector>
+
+#define USB_DESC_ATTR __attribute__((packed))
+
+#define USB_CLASS_AUDIO 0x01
+
+#define USB_B_DESCRIPTOR_TYPE_DEVICE                    0x01
+#define USB_B_DESCRIPTOR_TYPE_CONFIGURATION             0x02
+#define USB_B_DESCRIPTOR_TYPE_STRING                    0x03
+#define USB_B_DESCRIPTOR_TYPE_INTERFACE                 0x04
+#define USB_B_DESCRIPTOR_TYPE_ENDPOINT                  0x05
+#define USB_B_DESCRIPTOR_TYPE_DEVICE_QUALIFIER          0x06
+#define USB_B_DESCRIPTOR_TYPE_OTHER_SPEED_CONFIGURATION 0x07
+#define USB_B_DESCRIPTOR_TYPE_INTERFACE_POWER           0x08
+
+#define USB_BM_ATTRIBUTES_XFERTYPE_MASK    0x03
+#define USB_BM_ATTRIBUTES_XFER_BULK        0x02
+#define USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK 0x80
+#define USB_BM_ATTRIBUTES_SELFPOWER        0x40
+#define USB_BM_ATTRIBUTES_WAKEUP           0x20
+#define USB_BM_ATTRIBUTES_BATTERY          0x10
+
+#define USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS 0x01
+#define USB_HOST_LIB_EVENT_FLAGS_ALL_FREE   0x02
+
+typedef struct host_usb_device *usb_device_handle_t;
+typedef void *usb_host_client_handle_t;
+
+typedef union {
+  struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t bDeviceClass;
+    uint8_t bDeviceSubClass;
+    uint8_t bDeviceProtocol;
+    uint8_t bMaxPacketSize0;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    uint8_t iManufacturer;
+    uint8_t iProduct;
+    uint8_t iSerialNumber;
+    uint8_t bNumConfigurations;
+  } USB_DESC_ATTR;
+  uint8_t val[18];
+} usb_device_desc_t;
+
+typedef union {
+  struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t wTotalLength;
+    uint8_t bNumInterfaces;
+    uint8_t bConfigurationValue;
+    uint8_t iConfiguration;
+    uint8_t bmAttributes;
+    uint8_t bMaxPower;
+  } USB_DESC_ATTR;
+  uint8_t val[9];
+} usb_config_desc_t;
+
+typedef union {
+  struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bInterfaceNumber;
+    uint8_t bAlternateSetting;
+    uint8_t bNumEndpoints;
+    uint8_t bInterfaceClass;
+    uint8_t bInterfaceSubClass;
+    uint8_t bInterfaceProtocol;
+    uint8_t iInterface;
+  } USB_DESC_ATTR;
+  uint8_t val[9];
+} usb_intf_desc_t;
+
+typedef union {
+  struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bEndpointAddress;
+    uint8_t bmAttributes;
+    uint16_t wMaxPacketSize;
+    uint8_t bInterval;
+  } USB_DESC_ATTR;
+  uint8_t val[7];
+} usb_ep_desc_t;
+
+typedef union {
+  struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bFirstInterface;
+    uint8_t bInterfaceCount;
+    uint8_t bFunctionClass;
+    uint8_t bFunctionSubClass;
+    uint8_t bFunctionProtocol;
+    uint8_t iFunction;
+  } USB_DESC_ATTR;
+  uint8_t val[8];
+} usb_iad_desc_t;
+
+typedef struct {
+  int speed;
+  uint8_t dev_addr;
+  uint8_t bMaxPacketSize0;
+  uint8_t bConfigurationValue;
+} usb_device_info_t;
+
+typedef enum {
+  USB_TRANSFER_STATUS_COMPLETED,
+  USB_TRANSFER_STATUS_ERROR,
+  USB_TRANSFER_STATUS_TIMED_OUT,
+  USB_TRANSFER_STATUS_CANCELED,
+  USB_TRANSFER_STATUS_STALL,
+  USB_TRANSFER_STATUS_OVERFLOW,
+  USB_TRANSFER_STATUS_SKIPPED,
+  USB_TRANSFER_STATUS_NO_DEVICE,
+} usb_transfer_status_t;
+
+struct usb_transfer_s;
+typedef void (*usb_transfer_cb_t)(struct usb_transfer_s *transfer);
+
+typedef struct usb_transfer_s {
+  uint8_t *data_buffer;
+  size_t data_buffer_size;
+  int num_bytes;
+  int actual_num_bytes;
+  uint32_t flags;
+  usb_device_handle_t device_handle;
+  uint8_t bEndpointAddress;
+  usb_transfer_status_t status;
+  uint32_t timeout_ms;
+  usb_transfer_cb_t callback;
+  void *context;
+} usb_transfer_t;
+
+typedef enum {
+  USB_HOST_CLIENT_EVENT_NEW_DEV = 1,
+  USB_HOST_CLIENT_EVENT_DEV_GONE,
+} usb_host_client_event_t;
+
+typedef struct {
+  usb_host_client_event_t event;
+  union {
+    struct {
+      uint8_t address;
+    } new_dev;
+    struct {
+      usb_device_handle_t dev_hdl;
+    } dev_gone;
+  };
+} usb_host_client_event_msg_t;
+
+typedef void (*usb_host_client_event_cb_t)(const usb_host_client_event_msg_t *event_msg, void *arg);
+
+typedef struct {
+  bool skip_phy_setup;
+  int intr_flags;
+} usb_host_config_t;
+
+typedef struct {
+  bool is_synchronous;
+  int max_num_event_msg;
+  struct {
+    usb_host_client_event_cb_t client_event_callback;
+    void *callback_arg;
+  } async;
+} usb_host_client_config_t;
+
+// the fake's side
+
+struct host_usb_device {
+  uint8_t address;
+  std::vector<uint8_t> config;          // the whole configuration descriptor
+  bool open;
+  int claims;
+};
+
+std::vector<host_usb_device *> host_usb_devices;
+std::vector<usb_transfer_t *> host_usb_submitted;   // in the order they were submitted
+usb_host_client_event_cb_t host_usb_client_cb;
+void *host_usb_client_arg;
+int host_usb_transfers_allocated;
+int host_usb_devices_open;
+
+inline esp_err_t usb_host_install(const usb_host_config_t *config) { return ESP_OK; }
+
+inline esp_err_t usb_host_client_register(const usb_host_client_config_t *config, usb_host_client_handle_t *client) {
+  host_usb_client_cb = config->async.client_event_callback;
+  host_usb_client_arg = config->async.callback_arg;
+  *client = (usb_host_client_handle_t) &host_usb_client_cb;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_lib_handle_events(TickType_t timeout, uint32_t *flags) { *flags = 0; return ESP_ERR_TIMEOUT; }
+inline esp_err_t usb_host_client_handle_events(usb_host_client_handle_t client, TickType_t timeout) { return ESP_ERR_TIMEOUT; }
+
+inline esp_err_t usb_host_device_open(usb_host_client_handle_t client, uint8_t address, usb_device_handle_t *handle) {
+  for (host_usb_device *d : host_usb_devices) {
+    if (d->address == address) {
+      d->open = true;
+      host_usb_devices_open++;
+      *handle = d;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_INVALID_ARG;
+}
+
+inline esp_err_t usb_host_device_close(usb_host_client_handle_t client, usb_device_handle_t handle) {
+  if (!handle->open) return ESP_ERR_INVALID_ARG;
+  handle->open = false;
+  host_usb_devices_open--;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_device_info(usb_device_handle_t handle, usb_device_info_t *info) {
+  info->speed = 1;
+  info->dev_addr = handle->address;
+  info->bMaxPacketSize0 = 64;
+  info->bConfigurationValue = 1;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_get_device_descriptor(usb_device_handle_t handle, const usb_device_desc_t **desc) {
+  static usb_device_desc_t dev = {{18, USB_B_DESCRIPTOR_TYPE_DEVICE, 0x0200, 0, 0, 0, 64, 0x1234, 0x5678, 0x0100, 1, 2, 0, 1}};
+  *desc = &dev;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_get_active_config_descriptor(usb_device_handle_t handle, const usb_config_desc_t **desc) {
+  *desc = (const usb_config_desc_t *) handle->config.data();
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_interface_claim(usb_host_client_handle_t client, usb_device_handle_t handle, uint8_t intf, uint8_t alt) {
+  handle->claims++;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_interface_release(usb_host_client_handle_t client, usb_device_handle_t handle, uint8_t intf) {
+  handle->claims--;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_transfer_alloc(size_t size, int isoc_packets, usb_transfer_t **transfer) {
+  usb_transfer_t *t = new usb_transfer_t();
+  t->data_buffer = new uint8_t[size]();
+  t->data_buffer_size = size;
+  host_usb_transfers_allocated++;
+  *transfer = t;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_transfer_free(usb_transfer_t *transfer) {
+  for (usb_transfer_t *t : host_usb_submitted)
+    if (t == transfer) return ESP_ERR_INVALID_ARG;          // the library refuses to free one in flight
+  delete[] transfer->data_buffer;
+  delete transfer;
+  host_usb_transfers_allocated--;
+  return ESP_OK;
+}
+
+inline esp_err_t usb_host_transfer_submit(usb_transfer_t *transfer) {
+  host_usb_submitted.push_back(transfer);
+  return ESP_OK;
+}
+
+// take a submitted transfer off the list, the first one for this device and endpoint direction
+inline usb_transfer_t *host_usb_take(usb_device_handle_t handle, bool in) {
+  for (auto it = host_usb_submitted.begin(); it != host_usb_submitted.end(); it++) {
+    if ((*it)->device_handle == handle && (((*it)->bEndpointAddress & 0x80) != 0) == in) {
+      usb_transfer_t *t = *it;
+      host_usb_submitted.erase(it);
+      return t;
+    }
+  }
+  return NULL;
+}
+
+inline esp_err_t usb_host_endpoint_halt(usb_device_handle_t handle, uint8_t ep) { return ESP_OK; }
+inline esp_err_t usb_host_endpoint_clear(usb_device_handle_t handle, uint8_t ep) { return ESP_OK; }
+
+inline esp_err_t usb_host_endpoint_flush(usb_device_handle_t handle, uint8_t ep) {
+  usb_transfer_t *t;
+
+  while ((t = host_usb_take(handle, ep & 0x80)) != NULL) {
+    t->status = USB_TRANSFER_STATUS_CANCELED;
+    t->actual_num_bytes = 0;
+    t->callback(t);
+  }
+  return ESP_OK;
+}
+
+// a MIDI device with one MIDI streaming interface and a bulk endpoint each way, plugged in
+inline usb_device_handle_t host_usb_plug(uint8_t address, uint16_t max_packet = 64) {
+  host_usb_device *d = new host_usb_device();
+  usb_host_client_event_msg_t msg;
+  uint8_t lo = max_packet & 0xff, hi = max_packet >> 8;
+
+  d->address = address;
+  d->config = {
+    9, USB_B_DESCRIPTOR_TYPE_CONFIGURATION, 9 + 9 + 7 + 7, 0, 1, 1, 0, 0x80, 50,
+    9, USB_B_DESCRIPTOR_TYPE_INTERFACE, 0, 0, 2, USB_CLASS_AUDIO, 3, 0, 0,
+    7, USB_B_DESCRIPTOR_TYPE_ENDPOINT, 0x81, USB_BM_ATTRIBUTES_XFER_BULK, lo, hi, 0,
+    7, USB_B_DESCRIPTOR_TYPE_ENDPOINT, 0x02, USB_BM_ATTRIBUTES_XFER_BULK, lo, hi, 0,
+  };
+  host_usb_devices.push_back(d);
+
+  msg.event = USB_HOST_CLIENT_EVENT_NEW_DEV;
+  msg.new_dev.address = address;
+  host_usb_client_cb(&msg, host_usb_client_arg);
+  return d;
+}
+
+inline void host_usb_unplug(usb_device_handle_t handle) {
+  usb_host_client_event_msg_t msg;
+
+  msg.event = USB_HOST_CLIENT_EVENT_DEV_GONE;
+  msg.dev_gone.dev_hdl = handle;
+  host_usb_client_cb(&msg, host_usb_client_arg);
+}
+
+// complete one IN transfer with these USB-MIDI event packets, false if none was waiting
+inline bool host_usb_in(usb_device_handle_t handle, const uint8_t *packets, int len) {
+  usb_transfer_t *t = host_usb_take(handle, true);
+
+  if (t == NULL) return false;
+  len = std::min(len, t->num_bytes);
+  memcpy(t->data_buffer, packets, len);
+  t->actual_num_bytes = len;
+  t->status = USB_TRANSFER_STATUS_COMPLETED;
+  t->callback(t);
+  return true;
+}
+
+// complete the OUT transfer to a device, and return what was in it
+inline std::vector<uint8_t> host_usb_out_done(usb_device_handle_t handle) {
+  usb_transfer_t *t = host_usb_take(handle, false);
+  std::vector<uint8_t> out;
+
+  if (t == NULL) return out;
+  out.assign(t->data_buffer, t->data_buffer + t->num_bytes);
+  t->actual_num_bytes = t->num_bytes;
+  t->status = USB_TRANSFER_STATUS_COMPLETED;
+  t->callback(t);
+  return out;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef midi_host_h
+#define midi_host_h
+
+// The sketch's MIDI.ino built on the host, with DIN through the fake UART in host/driver/uart.h
+// A test that defines USB_S3 and BLE_MIDI before including this gets those sources too, USB S3 through the
+// fake USB host library in host/usb/usb_host.h.
+// Everything the sketch would normally bring in around it is here: the log macros, the loop events and
+// the prototypes the Arduino builder makes for functions used before they are defined.
+
+#include "Arduino.h"
+
+#define DEB(...)
+#define DEBUG(...)
+
+#include "Trace.h"
+#include "LoopEvents.h"
+
+EventBits_t host_loop_signals = 0;
+void loop_signal(EventBits_t bits) { host_loop_signals |= bits; }
+
+#include "MIDI.h"
+#include "MidiOut.h"
+
+void ble_midi_message(uint8_t *msg, int timestamp, unsigned long arrival);
+bool midi_event_space();
+
+#ifdef USB_S3
+void show_config_desc_full(int d, const usb_config_desc_t *config_desc);
+
+// MidiOut.ino needs the amp's state, so only count what update_midi() asks of it
+int host_feedback_resends = 0;
+void midi_feedback_resend(int out) { host_feedback_resends++; }
+#endif
+
+#include "MIDI.ino"
+
+// the messages waiting in the MIDI event queue, in order
+std::vector<midi_event> host_take_events() {
+  std::vector<midi_event> out;
+  midi_event ev;
+
+  while (next_midi_event(&ev)) out.push_back(ev);
+  return out;
+}
+
+#endif
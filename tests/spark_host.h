@@ -0,0 +1,104 @@
+#ifndef spark_host_h
+#define spark_host_h
+
+// The sketch's Spark.ino and SparkIO.ino built on the host, with BLE writes to the amp and the app caught by a
+// fake send_to_spark() / send_to_app() instead of SparkComms.ino
+//
+// The fake amp acks every 0x01xx message it is sent, apart from the parameter changes (0x0104) that the real
+// amp doesn't ack. The ack is put in qFromSpark as a BLE packet, as notifyCB_sp() would, so it only counts
+// once process_sparkIO() has read it.
+
+#include "Arduino.h"
+
+#define DEB(...)
+#define DEBUG(...)
+
+#include "Trace.h"
+#include "LoopEvents.h"
+
+void loop_signal(EventBits_t bits) {}
+
+#include "SparkIO.h"
+#include "Spark.h"
+#include "Models.h"
+#include "Macro.h"
+#include "SparkPresets.h"
+#include "Setlist.h"
+
+// from SparkComms.ino, which isn't built here
+unsigned long lastAppPacketTime;
+unsigned long lastSparkPacketTime;
+void connect_spark() {}
+bool connect_to_all() { return true; }
+
+// prototypes the Arduino builder makes for SparkIO.ino
+void new_packet_from_data(struct packet_data *pd, uint8_t *data, int length);
+int remove_headers(CircularArray &out_block, CircularArray &in_block, int in_len);
+void fix_bit_eight(CircularArray &in_block, int in_len);
+int compact(CircularArray &out_block, CircularArray &in_block, int in_len);
+
+std::vector<std::vector<uint8_t>> host_spark_writes;
+std::vector<std::vector<uint8_t>> host_app_writes;
+bool host_amp_acks = true;
+int host_latency_sent = 0;
+
+void latency_sent() { host_latency_sent++; }
+
+// an ack from the amp, in a block of its own
+void host_amp_ack(uint8_t sub, uint8_t sequence) {
+  uint8_t block[23] = {0x01, 0xfe, 0x00, 0x00, 0x41, 0xff, 23, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                       0xf0, 0x01, sequence, 0x00, 0x04, sub, 0xf7};
+  struct packet_data pd;
+
+  new_packet_from_data(&pd, block, sizeof(block));
+  xQueueSend(qFromSpark, &pd, 0);
+}
+
+void send_to_spark(byte *buf, int len) {
+  int i, last_seq;
+
+  host_spark_writes.push_back(std::vector<uint8_t>(buf, buf + len));
+  if (!host_amp_acks) return;
+  // each chunk header is f0 01 <sequence> <checksum> <cmd> <sub> - a multi-chunk message is acked once a write
+  last_seq = -1;
+  for (i = 0; i + 5 < len; i++)
+    if (buf[i] == 0xf0 && buf[i + 1] == 0x01 && buf[i + 4] == 0x01 && buf[i + 5] != 0x04 && buf[i + 2] != last_seq) {
+      host_amp_ack(buf[i + 5], buf[i + 2]);
+      last_seq = buf[i + 2];
+    }
+}
+
+void send_to_app(byte *buf, int len) {
+  host_app_writes.push_back(std::vector<uint8_t>(buf, buf + len));
+}
+
+#include "CircularArray.ino"
+#include "SparkIO.ino"
+#include "Spark.ino"
+#include "Models.ino"
+#include "Macro.ino"
+#include "Setlist.ino"
+
+// the queues SparkComms.ino would make, and preset n from SparkPresets.h as what the amp has now
+void host_spark_setup(int n) {
+  qFromApp = xQueueCreate(20, sizeof (struct packet_data));
+  qFromSpark = xQueueCreate(20, sizeof (struct packet_data));
+  presets[CUR_EDITING][0] = *my_presets[n];
+  current_input = 0;
+  num_presets = 4;
+  max_preset = 3;
+}
+
+void host_clear_writes() {
+  host_spark_writes.clear();
+  host_app_writes.clear();
+}
+
+int host_bytes(const std::vector<std::vector<uint8_t>> &writes) {
+  int n = 0;
+
+  for (auto &w : writes) n += w.size();
+  return n;
+}
+
+#endif
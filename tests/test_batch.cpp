@@ -0,0 +1,136 @@
+// Multi-effect actions through the 0x01fe block batching - how many BLE writes and bytes each takes, and that
+// no block is bigger than the amp's 173 bytes or the app's 106
+//
+// A footswitch that toggles three effects is sent as loop() sends it, with one flush_sparkIO() at the end, and 
+// as the code did before batching, a write for each message. Then the built in macros are run.
+
+#include "spark_host.h"
+#include "check.h"
+
+#include <chrono>
+
+// messages in a write - each starts a chunk with f0 01, and the data bytes never have the top bit set
+int chunks(const std::vector<uint8_t> &w) {
+  int n = 0;
+
+  for (size_t i = 0; i + 1 < w.size(); i++) 
+    if (w[i] == 0xf0 && w[i + 1] == 0x01) n++;
+  return n;
+}
+
+void check_sizes() {
+  for (auto &w : host_spark_writes) CHECK(w.size() <= 173);
+  for (auto &w : host_app_writes) CHECK(w.size() <= 106);
+}
+
+void three_toggles(bool batched) {
+  change_drive_toggle();
+  if (!batched) flush_sparkIO();
+  change_mod_toggle();
+  if (!batched) flush_sparkIO();
+  change_delay_toggle();
+  flush_sparkIO();
+}
+
+void check_toggles() {
+  int direct_writes, direct_bytes, batched_bytes;
+  double us;
+
+  host_spark_setup(0);
+  host_clear_writes();
+  three_toggles(false);
+  CHECK_EQ(host_spark_writes.size(), 3);
+  CHECK_EQ(host_app_writes.size(), 3);
+  direct_writes = host_spark_writes.size() + host_app_writes.size();
+  direct_bytes = host_bytes(host_spark_writes) + host_bytes(host_app_writes);
+  check_sizes();
+
+  host_spark_setup(0);
+  host_clear_writes();
+  three_toggles(true);
+  CHECK_EQ(host_spark_writes.size(), 1);
+  CHECK_EQ(host_app_writes.size(), 1);
+  CHECK_EQ(chunks(host_spark_writes[0]), 3);
+  CHECK_EQ(chunks(host_app_writes[0]), 3);
+  batched_bytes = host_bytes(host_spark_writes) + host_bytes(host_app_writes);
+  CHECK(batched_bytes < direct_bytes);
+  check_sizes();
+
+  // host time to encode, queue and write one action
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 10000; i++) {
+    host_clear_writes();
+    three_toggles(true);
+  }
+  us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 10000;
+
+  printf("three toggles, a write per message: %d writes, %d bytes on air\n", direct_writes, direct_bytes);
+  printf("three toggles, batched:             %d writes, %d bytes on air, %.2f us on the host\n", 
+         (int) (host_spark_writes.size() + host_app_writes.size()), batched_bytes, us);
+}
+
+// a macro's model change goes in a write of its own, and the rest after the amp has acked it, in as many
+// blocks as they need
+void check_macro(int num, int want_writes) {
+  const macro_step *st;
+  int models, messages, sent;
+
+  host_spark_setup(0);
+  host_clear_writes();
+  messages = spark_batch.messages;
+  models = 0;
+  for (st = macros[num].steps; st->type != MACRO_END; st++)
+    if (st->type == MACRO_MODEL) models++;
+
+  run_macro(num);
+  flush_sparkIO();
+  CHECK_EQ(models, 1);
+  CHECK_EQ(host_spark_writes.size(), want_writes);
+  CHECK_EQ(chunks(host_spark_writes[0]), 1);
+  CHECK_EQ(host_spark_writes[0][20] << 8 | host_spark_writes[0][21], 0x0106);
+  sent = 0;
+  for (auto &w : host_spark_writes) sent += chunks(w);
+  CHECK_EQ(sent, spark_batch.messages - messages);
+  check_sizes();
+  printf("macro %s: %lu messages, %zu writes to the amp, %zu to the app, %d bytes on air\n", macros[num].name,
+         spark_batch.messages - messages, host_spark_writes.size(), host_app_writes.size(), 
+         host_bytes(host_spark_writes) + host_bytes(host_app_writes));
+}
+
+// more messages than fit in one block are split over several, none too big and none lost
+void check_split() {
+  unsigned long spark_messages, app_messages;
+  int spark_chunks, app_chunks, slot, param;
+
+  host_spark_setup(0);
+  host_clear_writes();
+  spark_messages = spark_batch.messages;
+  app_messages = app_batch.messages;
+  for (slot = 0; slot < 7; slot++)
+    for (param = 0; param < presets[CUR_EDITING][0].effects[slot].NumParameters; param++)
+      change_generic_param(slot, param, 0.5 + param * 0.01);
+  host_us += PARAM_FLUSH_INTERVAL * 1000;
+  flush_param_changes();
+  flush_sparkIO();
+
+  spark_chunks = 0;
+  for (auto &w : host_spark_writes) spark_chunks += chunks(w);
+  app_chunks = 0;
+  for (auto &w : host_app_writes) app_chunks += chunks(w);
+  CHECK(host_spark_writes.size() > 1);
+  CHECK(host_app_writes.size() > host_spark_writes.size());
+  CHECK_EQ(spark_chunks, spark_batch.messages - spark_messages);
+  CHECK_EQ(app_chunks, app_batch.messages - app_messages);
+  check_sizes();
+  printf("%d parameter changes at once: %zu writes to the amp, %zu to the app\n", 
+         spark_chunks, host_spark_writes.size(), host_app_writes.size());
+}
+
+int main() {
+  check_toggles();
+  CHECK_EQ(num_macros, 2);
+  check_macro(0, 3);                      // Lead - the model change, then 7 messages in two blocks
+  check_macro(1, 2);                      // Clean - the model change, then 5 in one
+  check_split();
+  return check_result();
+}
@@ -0,0 +1,125 @@
+// connect_to_all() in a simulated advertising environment
+//
+// Each device advertises every interval ms from a random phase, plus the 0 to 10 ms random delay BLE adds
+// to each advertisement, and each one is heard with probability p. A few other devices advertise too.
+// Connecting to a device that is on takes 50 ms. None of this is measured from real devices.
+
+#include "ble_host.h"
+#include "check.h"
+
+#include <random>
+
+std::mt19937 rng(1);
+
+double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng); }
+
+// interval 0 for a device that isn't there
+void add_device(const char *name, const char *service, const char *address, unsigned long boot, 
+                unsigned long on_after, unsigned long interval, double p, int subscribe_failures = 0) {
+  host_ble_device d {name, service, address, boot + on_after, {}, subscribe_failures};
+  double t;
+
+  if (interval == 0) return;
+  for (t = d.on_ms + uniform() * interval; t < boot + 60000; t += interval + uniform() * 10)
+    if (uniform() < p) d.adverts.push_back((unsigned long) t);
+  host_ble_env.push_back(d);
+}
+
+struct rig {
+  const char *name;
+  unsigned long spark_interval;
+  unsigned long spark_on;               // ms after boot that the Spark is switched on
+  unsigned long pedal_interval;         // 0 for no pedal
+  double p;
+  bool known;                           // a later boot, with the Spark and pedal saved in NVS
+  int subscribe_failures;               // the Spark's first subscribes fail
+};
+
+unsigned long first_advert(const char *address) {
+  for (host_ble_device &d : host_ble_env)
+    if (d.address == address && !d.adverts.empty()) return d.adverts[0];
+  return 1000000000;
+}
+
+// the code this replaced - ten 4 s scans for the Spark, then up to two more for the pedal, each running 
+// its full 4 s - worked out from the same advertisements rather than run
+unsigned long old_scans(unsigned long boot, bool pedal) {
+  unsigned long spark, t;
+
+  spark = first_advert("08:eb:ed:00:00:01") - boot;
+  t = 4000 * (spark / 4000 + 1);
+  if (!pedal) return t + 8000;
+  for (unsigned long a : host_ble_env[1].adverts)
+    if (a - boot >= t) return (a - boot < t + 4000) ? t + 4000 : t + 8000;
+  return t + 8000;
+}
+
+// the devices around for one boot
+void environment(const rig &r, unsigned long boot) {
+  host_ble_env.clear();
+  add_device("Spark 40 BLE", C_SERVICE, "08:eb:ed:00:00:01", boot, r.spark_on, r.spark_interval, r.p, r.subscribe_failures);
+  add_device("iRig BlueBoard", PEDAL_SERVICE, "60:8a:10:00:00:02", boot, 0, r.pedal_interval, r.p);
+  add_device("phone", "180f", "40:00:00:00:00:03", boot, 0, 100, r.p);
+  add_device("watch", "180d", "40:00:00:00:00:04", boot, 0, 250, r.p);
+  add_device("speaker", "fe2c", "40:00:00:00:00:05", boot, 0, 40, r.p);
+}
+
+void run(const rig &r, int runs) {
+  unsigned long boot, worst, old_total;
+  double total;
+  int i, pedals;
+
+  host_nvs.clear();
+  if (r.known) {
+    // a first boot finds and saves them, and isn't counted
+    host_us += 100000000;
+    environment({"", r.spark_interval, 0, r.pedal_interval, r.p, false, 0}, millis());
+    CHECK(connect_to_all());
+  }
+
+  total = 0;
+  old_total = 0;
+  worst = 0;
+  pedals = 0;
+  for (i = 0; i < runs; i++) {
+    host_us += 100000000;
+    boot = millis();
+    if (!r.known) host_nvs.clear();
+    environment(r, boot);
+
+    CHECK(connect_to_all());
+    CHECK(connected_sp);
+    CHECK_EQ(direct_connect, r.known && r.spark_on == 0 && r.subscribe_failures == 0);
+    if (connected_pedal) pedals++;
+    total += connect_time;
+    worst = std::max(worst, connect_time);
+    if (!r.known) old_total += old_scans(boot, r.pedal_interval > 0) + host_ble_connect_ms * (r.pedal_interval > 0 ? 2 : 1);
+  }
+  printf("%-34s connected in %5.0f ms on average, at worst %5lu ms, pedal connected %d/%d", 
+         r.name, total / runs, worst, pedals, runs);
+  if (!r.known) printf("  (old scans %5lu ms)", old_total / runs);
+  printf("\n");
+  CHECK_EQ(pedals, r.pedal_interval > 0 ? runs : 0);
+}
+
+int main(int argc, char **argv) {
+  int runs = argc > 1 ? atoi(argv[1]) : 1000;
+
+  rig rigs[] {
+    {"Spark 100 ms, pedal 100 ms",         100,    0, 100, 0.7, false, 0},
+    {"Spark 100 ms, no pedal",             100,    0,   0, 0.7, false, 0},
+    {"Spark 1 s, pedal 30 ms",            1000,    0,  30, 0.7, false, 0},
+    {"Spark on 5 s late, pedal 100 ms",    100, 5000, 100, 0.7, false, 0},
+    {"saved, Spark 100 ms, pedal 100 ms",  100,    0, 100, 0.7, true,  0},
+    {"saved, Spark on 5 s late",           100, 5000, 100, 0.7, true,  0},
+    {"saved, Spark's subscribe fails",     100,    0, 100, 0.7, true,  1},
+  };
+
+  for (rig &r : rigs) {
+    run(r, runs);
+    fflush(stdout);
+  }
+  CHECK_EQ(host_ble_connect_while_scanning, 0);
+  CHECK_EQ(host_ble_deleted_use, 0);
+  return check_result();
+}
@@ -0,0 +1,224 @@
+// BLEMIDIParser on replayed notifications, and an expression pedal through BLE connection intervals with
+// and without BLE_MIDI_DEJITTER (the cmake file builds this twice)
+//
+// The notifications in data/ble_*.txt are constructed from the BLE-MIDI spec in the style of each device,
+// not recorded, and the pedal here is a model - a CC every 7 ms, sent at 15 ms connection events, each
+// delivered 0 to 4 ms late at random. 
+
+#define BLE_MIDI
+
+#include "midi_host.h"
+#include "check.h"
+#include "corpus.h"
+
+#include <random>
+
+int midi_len(uint8_t status) {
+  if (status >= 0xF8 || status == 0xF6) return 1;
+  if ((status & 0xE0) == 0xC0 || status == 0xF1 || status == 0xF3) return 2;
+  return 3;
+}
+
+// a notification arriving now, and everything it gives once held messages are due
+// with BLE_MIDI_DEJITTER only CCs are held, so they come out after the rest - the messages are sorted so
+// the capture files work for both
+std::string notify(const std::vector<uint8_t> &p) {
+  std::vector<std::string> msgs;
+  std::string out;
+
+  ble_midi.parse_packet(p.data(), p.size(), micros());
+#ifdef BLE_MIDI_DEJITTER
+  host_us += BLE_MIDI_DEJITTER_MS * 1000UL;
+#endif
+  update_midi();
+  for (midi_event &e : host_take_events()) {
+    CHECK_EQ(e.source, MIDI_SRC_BLE);
+    msgs.push_back(midi_text(e.msg, midi_len(e.msg[0])));
+  }
+  host_us += 10000;
+  for (std::string &m : msgs) corpus_append(out, m);
+  return out;
+}
+
+#ifdef BLE_MIDI_DEJITTER
+std::string sorted(const std::string &s) {
+  std::istringstream in(s);
+  std::vector<std::string> msgs;
+  std::string m, out;
+
+  while (in >> m) msgs.push_back(m);
+  std::sort(msgs.begin(), msgs.end());
+  for (std::string &m : msgs) corpus_append(out, m);
+  return out;
+}
+#endif
+
+void replay(const char *path) {
+  std::vector<corpus_line> capture;
+  unsigned long bad;
+
+  if (!read_corpus(path, capture)) {
+    check_failures++;
+    return;
+  }
+  ble_midi.reset();
+  for (corpus_line &l : capture) {
+#ifdef BLE_MIDI_DEJITTER
+    l.want = sorted(l.want);
+    if (!corpus_check(path, l, sorted(notify(corpus_bytes(l.in))))) check_failures++;
+#else
+    if (!corpus_check(path, l, notify(corpus_bytes(l.in)))) check_failures++;
+#endif
+  }
+  printf("%s: %lu notifications, %lu bad\n", path, ble_midi.packets + ble_midi.bad_packets, ble_midi.bad_packets);
+}
+
+// the pedal model - returns the standard deviation of the time between CCs as loop() gets them, in ms
+double pedal(int count) {
+  std::mt19937 rng(7);
+  std::vector<unsigned long> sent, out;
+  std::vector<uint8_t> p;
+  std::vector<midi_event> ev;
+  unsigned long start, conn, next_conn, arrive, wake, sender_offset, late, max_late;
+  int i, ts;
+  double mean, var;
+
+  // a newly connected pedal - the replayed captures' timestamps mean nothing against this clock
+#ifdef BLE_MIDI_DEJITTER
+  ble_dejitter.reset();
+#endif
+  ble_midi.reset();
+  start = host_us;
+  sender_offset = 3000;                   // the pedal's clock is 3 s ahead of ours
+  for (i = 0; i < count; i++) sent.push_back(start + i * 7000UL);
+
+  i = 0;
+  conn = start;
+  host_us = start;
+  while (out.size() < (size_t) count && conn < start + count * 7000UL + 1000000) {
+    // the messages sent since the last connection event go in one notification, a little late
+    p.clear();
+    while (i < count && sent[i] <= conn) {
+      ts = ((sent[i] / 1000) + sender_offset) & BLE_MIDI_TS_MASK;
+      if (p.empty()) p.push_back(0x80 | (ts >> 7 & 0x3F));
+      p.insert(p.end(), {(uint8_t) (0x80 | (ts & 0x7F)), 0xB0, 0x07, (uint8_t) (i & 0x7F)});
+      i++;
+    }
+    arrive = conn + (rng() % 5) * 1000;
+    next_conn = conn + 15000;
+
+    // loop() until then, sleeping as long as it is told it can
+    while (host_us < next_conn) {
+      if (!p.empty() && host_us >= arrive) {
+        ble_midi.parse_packet(p.data(), p.size(), micros());
+        p.clear();
+      }
+      update_midi();
+      for (midi_event &e : host_take_events()) out.push_back(micros());
+      wake = std::min(next_conn, host_us + ble_midi_wait() * 1000);
+      if (!p.empty()) wake = std::min(wake, arrive);
+      host_us = std::max(wake, host_us + 1);
+    }
+    conn = next_conn;
+  }
+  CHECK_EQ(out.size(), count);
+  if (out.size() < (size_t) count) return 0;
+
+  // the first second is left out - the de-jitter is still finding the quickest delay
+  mean = 0;
+  var = 0;
+  max_late = 0;
+  int n = 0;
+  for (i = 1; i < count; i++) {
+    if (sent[i] - start < 1000000) continue;
+    mean += (out[i] - out[i - 1]) / 1000.0;
+    late = out[i] - sent[i];
+    if (late > max_late) max_late = late;
+    n++;
+  }
+  mean /= n;
+  for (i = 1; i < count; i++) {
+    if (sent[i] - start < 1000000) continue;
+    double d = (out[i] - out[i - 1]) / 1000.0 - mean;
+    var += d * d;
+  }
+  printf("pedal, %d CCs every 7 ms: mean interval %.2f ms, standard deviation %.2f ms, latest %.1f ms after sending\n",
+         count, mean, sqrt(var / n), max_late / 1000.0);
+  return sqrt(var / n);
+}
+
+// clock ticks sent in one connection interval arrive together, but each is given the time of its own
+// timestamp relative to the packet's last one - a CC in the same packet keeps the packet's arrival
+void check_clock() {
+  std::vector<uint8_t> p;
+  std::vector<midi_event> ev;
+  unsigned long t;
+  int i;
+
+  host_us = 30000000;
+  t = host_us;
+  p = corpus_bytes("80 80 F8 85 F8 8A F8 8A B1 07 40 8F F8");
+  ble_midi.parse_packet(p.data(), p.size(), micros());
+  p = corpus_bytes("85 FE F8 81 F8");               // 0x02FE then 0x0301, across the low byte wrap
+  ble_midi.parse_packet(p.data(), p.size(), micros());
+  update_midi();
+  ev = host_take_events();
+  CHECK_EQ(ev.size(), 7);
+  if (ev.size() != 7) return;
+  for (i = 0; i < 4; i++) {
+    CHECK_EQ(ev[i < 3 ? i : 4].msg[0], 0xF8);
+    CHECK_EQ(t - ev[i < 3 ? i : 4].arrival, (3 - i) * 5000);
+  }
+  CHECK_EQ(ev[3].msg[0], 0xB1);
+  CHECK_EQ(ev[3].arrival, t);
+  CHECK_EQ(t - ev[5].arrival, 3000);
+  CHECK_EQ(t - ev[6].arrival, 0);
+}
+
+#ifdef BLE_MIDI_DEJITTER
+// a timestamp whose low byte wraps inside a notification - the second CC is 3 ms after the first, not 125 ms before
+void check_wrap() {
+  std::vector<uint8_t> p;
+  std::vector<midi_event> ev;
+  unsigned long t;
+  int i;
+
+  ble_dejitter.reset();
+  host_us = 20000000;
+  t = host_us;
+  p = corpus_bytes("86 81 B0 07 01");               // 0x0301, the quickest delay
+  ble_midi.parse_packet(p.data(), p.size(), micros());
+  p = corpus_bytes("85 FE B0 07 02 81 B0 07 03");   // 0x02FE, then 0x0301
+  ble_midi.parse_packet(p.data(), p.size(), micros());
+
+  // all held - the second CC of the wrap packet would have gone straight on if it looked 125 ms late
+  update_midi();
+  CHECK_EQ(host_take_events().size(), 0);
+
+  // and they come out in the order they came in
+  host_us = t + BLE_MIDI_DEJITTER_MS * 1000;
+  update_midi();
+  ev = host_take_events();
+  CHECK_EQ(ev.size(), 3);
+  for (i = 0; i < (int) ev.size(); i++) CHECK_EQ(ev[i].msg[2], i + 1);
+}
+#endif
+
+int main() {
+  double sd;
+
+  setup_midi();
+  replay("data/ble_irig_blueboard.txt");
+  replay("data/ble_widi_jack.txt");
+
+  check_clock();
+  sd = pedal(600);
+#ifdef BLE_MIDI_DEJITTER
+  CHECK(sd < 1.0);
+  check_wrap();
+#else
+  CHECK(sd > 3.0);
+#endif
+  CHECK_EQ(midi_events_dropped, 0);
+  return check_result();
+}
@@ -0,0 +1,86 @@
+// DeferredLog when the ring fills - what is counted as dropped, and what is written to Serial
+//
+// Nothing drains the ring here, as the drain task is never started on the host, so the ring fills and
+// hold() writes it out. Serial is caught in a file to check the lines that come out.
+
+#include "Arduino.h"
+#include "check.h"
+
+#include <string>
+#include <unistd.h>
+
+#include "DeferredLog.ino"
+
+// what hold() writes to Serial
+std::string written() {
+  char buf[256];
+  std::string out;
+  FILE *f;
+  size_t n;
+  int saved;
+
+  f = tmpfile();
+  fflush(stdout);
+  saved = dup(fileno(stdout));
+  dup2(fileno(f), fileno(stdout));
+  dlog.hold();
+  dlog.release();
+  fflush(stdout);
+  dup2(saved, fileno(stdout));
+  close(saved);
+
+  rewind(f);
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+  fclose(f);
+  return out;
+}
+
+// fill the ring to leave room for free items, with lines of one item
+void fill(int free) {
+  written();
+  for (int i = 0; i < LOG_ITEMS - 1 - free; i++) dlog.println("x");
+}
+
+std::string tail(const std::string &s) {
+  return s.substr(s.rfind("x\n") + 2);
+}
+
+int main() {
+  std::string out;
+
+  // a line that runs out of room after two items loses the rest of itself, and the two are ended before
+  // the next line, which doesn't join on to them
+  fill(2);
+  dlog.print("a");
+  dlog.print("b");
+  dlog.print("c");
+  dlog.print(5);
+  dlog.println("d");
+  CHECK_EQ(dlog.items_dropped, 3);
+  CHECK_EQ(dlog.lines_dropped, 1);
+  out = written();
+  dlog.println("next");
+  out += written();
+  CHECK(tail(out) == "ab [dropped]\nnext\n");
+  printf("cut line: %s", tail(out).c_str());
+
+  // once an item is dropped the rest of the line goes, even if there is room again
+  fill(0);
+  dlog.print("e");
+  written();
+  dlog.println("f");
+  CHECK_EQ(dlog.items_dropped, 5);
+  CHECK_EQ(dlog.lines_dropped, 2);
+  CHECK(written() == "");
+
+  // a line dropped from its first item leaves nothing to end
+  fill(0);
+  dlog.println("gone");
+  out = written();
+  dlog.println("next");
+  out += written();
+  CHECK(tail(out) == "next\n");
+  CHECK_EQ(dlog.lines_dropped, 3);
+
+  return check_result();
+}
@@ -0,0 +1,81 @@
+// Mapping profile lines as read from LittleFS - what loads, and what is turned down as tools/mapc.py would
+
+#include "Arduino.h"
+#include "check.h"
+
+#define DEB(x)
+#define DEBUG(x)
+
+#include "MidiMap.ino"
+
+midi_map_t map;
+
+bool parse(const char *text) {
+  char line[MIDI_MAP_LINE_MAX + 1];
+
+  strncpy(line, text, MIDI_MAP_LINE_MAX);
+  line[MIDI_MAP_LINE_MAX] = '\0';
+  midi_map_clear(&map);
+  return midi_map_parse_line(&map, line);
+}
+
+int mapped(int type) {
+  int count = 0;
+
+  for (int chan = 0; chan < 16; chan++)
+    for (int data1 = 0; data1 < 128; data1++)
+      if (map.action[type][chan][data1] != ACT_NONE) count++;
+  return count;
+}
+
+int main() {
+  // good lines
+  CHECK(parse("cc 1 20 drive"));
+  CHECK_EQ(map.action[MAP_CC][0][20], ACT_DRIVE);
+  CHECK_EQ(mapped(MAP_CC), 1);
+  CHECK(parse("cc 16 127 drive"));
+  CHECK_EQ(map.action[MAP_CC][15][127], ACT_DRIVE);
+  CHECK(parse("cc * 20 drive"));
+  CHECK_EQ(mapped(MAP_CC), 16);
+  CHECK(parse("pc 2 * preset_up"));
+  CHECK_EQ(mapped(MAP_PC), 128);
+  CHECK(parse("cc * 7 master log:0.1-0.9"));
+  CHECK(parse("# a comment"));
+  CHECK(parse(""));
+
+  // a channel or data1 that isn't a number, or is out of range, maps nothing and fails the file
+  const char *bad[] = {"cc x 20 drive", "cc 0 20 drive", "cc 17 20 drive", "cc 1x 20 drive", "cc -1 20 drive",
+                       "cc 1 x drive", "cc 1 20x drive", "cc 1 128 drive", "cc 1 -1 drive",
+                       "cc 1 20 nothing", "foo 1 20 drive", "cc 1 20",
+                       "cc 1 7 master log:a-0.9", "cc 1 7 master log:0.1-0.9x", "cc 1 7 master log:0.1",
+                       "cc 1 7 master log:0.1-1.5", "pc 1 7 drive log"};
+  for (const char *line : bad) {
+    bool loaded = parse(line);
+    if (loaded) printf("loaded: %s\n", line);
+    CHECK(!loaded);
+    CHECK_EQ(mapped(MAP_CC) + mapped(MAP_PC), 0);
+  }
+
+  // a file with a bad line is not loaded, and the profile in use stays
+  setup_midi_map();
+  host_fs["/map1.txt"] = "cc 1 20 drive\ncc 1 21 mod\n";
+  host_fs["/map2.txt"] = "cc 1 20 drive\ncc x 21 mod\n";
+  CHECK(midi_map_select(1));
+  CHECK_EQ(midi_map_profile, 1);
+  CHECK_EQ(midi_map->action[MAP_CC][0][21], ACT_MOD);
+  CHECK(!midi_map_select(2));
+  CHECK_EQ(midi_map_profile, 1);
+  CHECK(!midi_map_select(3));
+  CHECK_EQ(midi_map_profile, 1);
+
+  // a later line for a cc takes its curve as well as its action - with no curve it is back to lin 0-1
+  host_fs["/map3.txt"] = "cc 1 7 master log\ncc 1 7 master\ncc * 8 gain exp:0.2-0.8\ncc 3 8 gain\n";
+  CHECK(midi_map_select(3));
+  CHECK_EQ(midi_map->action[MAP_CC][0][7], ACT_MASTER);
+  CHECK_EQ(midi_map->cc_curve[0][7], 0);
+  CHECK_EQ(midi_map->cc_curve[2][8], 0);
+  CHECK(midi_map->cc_curve[1][8] != 0);
+  CHECK_EQ(midi_map->curve[midi_map->cc_curve[1][8]][0], 0.2f);
+
+  return check_result();
+}
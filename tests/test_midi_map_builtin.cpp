@@ -0,0 +1,64 @@
+// The built in mapping from midi_map_default() against the mapping file it was compiled from, loaded as a
+// profile - tools/mapc.py and midi_map_parse_line() must make the same table from the same lines.
+//
+// Built twice: with the sketch's MidiMapBuiltin.h and tools/map_builtin.txt, and with a MidiMapBuiltin.h
+// compiled from tests/data/map_curves.txt, which has curves and lines that change them.
+
+#include "Arduino.h"
+#include "check.h"
+
+#define DEB(x)
+#define DEBUG(x)
+
+#include "MidiMap.ino"
+
+midi_map_t builtin, loaded;
+
+bool read_file(const char *path, std::string *text) {
+  char buf[256];
+  size_t n;
+  FILE *f;
+
+  f = fopen(path, "r");
+  if (f == NULL) return false;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text->append(buf, n);
+  fclose(f);
+  return true;
+}
+
+int main() {
+  std::string text;
+  int differ;
+
+  CHECK(read_file(MIDI_MAP_SOURCE, &text));
+  host_fs["/map1.txt"] = text;
+  midi_map_default(&builtin);
+  CHECK(midi_map_load(&loaded, 1));
+
+  CHECK_EQ(builtin.num_curves, loaded.num_curves);
+  for (int i = 0; i < loaded.num_curves; i++) {
+    CHECK_EQ(builtin.spec[i].shape, loaded.spec[i].shape);
+    CHECK_EQ(builtin.spec[i].lo, loaded.spec[i].lo);
+    CHECK_EQ(builtin.spec[i].hi, loaded.spec[i].hi);
+  }
+  CHECK(memcmp(builtin.curve, loaded.curve, sizeof(loaded.curve)) == 0);
+
+  differ = 0;
+  for (int type = 0; type < MAP_TYPES; type++)
+    for (int c = 0; c < 16; c++)
+      for (int d = 0; d < 128; d++)
+        if (builtin.action[type][c][d] != loaded.action[type][c][d]) {
+          if (differ++ < 10) printf("type %d channel %d %d: built in %d, loaded %d\n", type, c + 1, d,
+                                    builtin.action[type][c][d], loaded.action[type][c][d]);
+        }
+  for (int c = 0; c < 16; c++)
+    for (int d = 0; d < 128; d++)
+      if (builtin.cc_curve[c][d] != loaded.cc_curve[c][d]) {
+        if (differ++ < 10) printf("cc channel %d %d: built in curve %d, loaded %d\n", c + 1, d,
+                                  builtin.cc_curve[c][d], loaded.cc_curve[c][d]);
+      }
+  CHECK_EQ(differ, 0);
+  printf("%s: %d curves\n", MIDI_MAP_SOURCE, loaded.num_curves);
+
+  return check_result();
+}
@@ -0,0 +1,69 @@
+// MIDIParser against the corpus in data/midi_parser_corpus.txt
+
+#include "midi_host.h"
+#include "check.h"
+#include "corpus.h"
+
+std::string parse_all(const std::vector<uint8_t> &bytes) {
+  MIDIParser parser;
+  uint8_t msg[3];
+  char text[16];
+  std::string out;
+
+  for (uint8_t b : bytes) {
+    if (!parser.parse(b, msg)) continue;
+    if (msg[0] == 0xF0) {
+      snprintf(text, sizeof(text), "SYSEX(%d%s)", parser.sysex_len, parser.sysex_overflow ? "+" : "");
+      corpus_append(out, text);
+    }
+    else
+      corpus_append(out, midi_text(msg, parser.msg_len));
+  }
+  return out;
+}
+
+// the same parser behind the DIN UART, through din_read() into the MIDI event queue
+void check_din() {
+  std::vector<uint8_t> in = corpus_bytes("B0 07 10 07 20 F8 F0 01 02 F7 C1");
+  std::vector<midi_event> ev;
+
+  host_uart_receive(in.data(), in.size());
+  host_loop_signals = 0;
+  din_read(5000);
+  ev = host_take_events();
+
+  // the SysEx is parsed but not wanted, and the C1 waits for its data byte
+  CHECK_EQ(ev.size(), 3);
+  CHECK_EQ(host_uart_rx.size(), 0);
+  CHECK(host_loop_signals & EV_MIDI_DIN);
+  if (ev.size() == 3) {
+    CHECK(memcmp(ev[0].msg, "\xB0\x07\x10", 3) == 0);
+    CHECK(memcmp(ev[1].msg, "\xB0\x07\x20", 3) == 0);
+    CHECK_EQ(ev[2].msg[0], 0xF8);
+    for (midi_event &e : ev) {
+      CHECK_EQ(e.source, MIDI_SRC_DIN);
+      CHECK_EQ(e.arrival, 5000);
+    }
+  }
+
+  in = corpus_bytes("05");
+  host_uart_receive(in.data(), in.size());
+  din_read(6000);
+  ev = host_take_events();
+  CHECK_EQ(ev.size(), 1);
+  if (ev.size() == 1) CHECK(memcmp(ev[0].msg, "\xC1\x05", 2) == 0);
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "data/midi_parser_corpus.txt";
+  std::vector<corpus_line> corpus;
+
+  if (!read_corpus(path, corpus)) return 1;
+  for (corpus_line &l : corpus)
+    if (!corpus_check(path, l, parse_all(corpus_bytes(l.in)))) check_failures++;
+  printf("%zu corpus streams\n", corpus.size());
+
+  setup_midi();
+  check_din();
+  return check_result();
+}
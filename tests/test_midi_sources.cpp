@@ -0,0 +1,218 @@
+// DIN, BLE and USB S3 MIDI arriving at once, through the real update_midi() and the MIDI event queue
+
+#define USB_S3
+#define BLE_MIDI
+
+#include "midi_host.h"
+#include "check.h"
+
+// one USB-MIDI event packet per message, cable 0
+std::vector<uint8_t> usb_packets(const std::vector<std::vector<uint8_t>> &msgs, int cable = 0) {
+  std::vector<uint8_t> out;
+
+  for (auto &m : msgs) out.insert(out.end(), {(uint8_t) (cable << 4 | m[0] >> 4), m[0], m[1], (uint8_t) (m.size() > 2 ? m[2] : 0)});
+  return out;
+}
+
+// a BLE-MIDI packet with a timestamp before each message
+std::vector<uint8_t> ble_packet(const std::vector<std::vector<uint8_t>> &msgs, int ts) {
+  std::vector<uint8_t> out {(uint8_t) (0x80 | ((ts >> 7) & 0x3F))};
+
+  for (auto &m : msgs) {
+    out.push_back(0x80 | (ts & 0x7F));
+    out.insert(out.end(), m.begin(), m.end());
+  }
+  return out;
+}
+
+// what loop() does with the sources each time round: update_midi(), then act on everything queued
+std::vector<midi_event> tick(bool *more) {
+  *more = update_midi();
+  return host_take_events();
+}
+
+// CC n from each source, in order
+void check_in_order(std::vector<midi_event> &ev, int source, int first, int count, int port = 0) {
+  int n = first;
+
+  for (midi_event &e : ev) {
+    if (e.source != source || e.port != port) continue;
+    CHECK_EQ(e.msg[1], n);
+    n++;
+  }
+  CHECK_EQ(n - first, count);
+}
+
+std::vector<std::vector<uint8_t>> ccs(int status, int first, int count) {
+  std::vector<std::vector<uint8_t>> out;
+
+  for (int i = 0; i < count; i++) out.push_back({(uint8_t) status, (uint8_t) (first + i), 0x40});
+  return out;
+}
+
+// ten CCs from each source in the same tick - all 30 get to loop(), each with its source
+void check_ten_each(usb_device_handle_t usb) {
+  std::vector<uint8_t> in;
+  std::vector<midi_event> ev;
+  bool more;
+
+  in = ble_packet(ccs(0xB0, 0, 10), 100);
+  ble_midi.parse_packet(in.data(), in.size(), micros());
+
+  in = usb_packets(ccs(0xB1, 0, 10));
+  CHECK(host_usb_in(usb, in.data(), in.size()));
+
+  in.clear();
+  for (auto &m : ccs(0xB2, 0, 10)) in.insert(in.end(), m.begin(), m.end());
+  host_uart_receive(in.data(), in.size());
+  din_read(micros());
+
+  ev = tick(&more);
+  CHECK(!more);
+  CHECK_EQ(ev.size(), 30);
+  CHECK_EQ(midi_events_dropped, 0);
+  check_in_order(ev, MIDI_SRC_BLE, 0, 10);
+  check_in_order(ev, MIDI_SRC_USB_S3, 0, 10);
+  check_in_order(ev, MIDI_SRC_DIN, 0, 10);
+  printf("ten CCs from each of three sources in one tick: %zu events, %lu dropped\n", ev.size(), midi_events_dropped);
+}
+
+// a burst of 100 notes, more than the event queue holds - what doesn't fit waits in the USB queue for the
+// next tick, and nothing is lost
+void check_burst(usb_device_handle_t usb) {
+  std::vector<uint8_t> in;
+  std::vector<midi_event> ev, all;
+  std::vector<std::vector<uint8_t>> notes;
+  bool more;
+  int ticks, i;
+
+  notes = ccs(0x90, 0, 30);
+  in = ble_packet(notes, 200);
+  ble_midi.parse_packet(in.data(), in.size(), micros());
+
+  // DIN with running status
+  in = {0x92};
+  for (i = 0; i < 30; i++) in.insert(in.end(), {(uint8_t) i, 0x40});
+  host_uart_receive(in.data(), in.size());
+  din_read(micros());
+
+  // 40 from USB, in transfers of 16 packets
+  in = usb_packets(ccs(0x91, 0, 40));
+  for (i = 0; i < (int) in.size(); i += 64)
+    CHECK(host_usb_in(usb, &in[i], std::min(64, (int) in.size() - i)));
+
+  ticks = 0;
+  do {
+    ev = tick(&more);
+    all.insert(all.end(), ev.begin(), ev.end());
+    ticks++;
+  } while (more || !ev.empty());
+  ticks--;                                // the last one found nothing
+
+  CHECK_EQ(all.size(), 100);
+  CHECK_EQ(ticks, 2);
+  CHECK_EQ(midi_events_dropped, 0);
+  CHECK_EQ(usb_midi_packets.overflows, 0);
+  check_in_order(all, MIDI_SRC_BLE, 0, 30);
+  check_in_order(all, MIDI_SRC_DIN, 0, 30);
+  check_in_order(all, MIDI_SRC_USB_S3, 0, 40);
+  printf("100 note burst: %zu events over %d ticks, %lu dropped, queue high water %d/%d\n", 
+         all.size(), ticks, midi_events_dropped, midi_events_high_water, MIDI_EVENT_QUEUE_SIZE);
+}
+
+// two USB devices - a SysEx split over transfers from one doesn't swallow the other's messages, and each
+// message says which device and cable it came from
+void check_two_devices(usb_device_handle_t a, usb_device_handle_t b) {
+  std::vector<uint8_t> in;
+  std::vector<midi_event> ev;
+  bool more;
+
+  in = {0x04, 0xF0, 0x01, 0x02};          // SysEx starts
+  CHECK(host_usb_in(a, in.data(), in.size()));
+  in = usb_packets({{0xB0, 0x07, 0x10}}, 1);
+  CHECK(host_usb_in(b, in.data(), in.size()));
+  in = {0x06, 0x03, 0xF7, 0x00};          // SysEx ends with two bytes
+  in.insert(in.end(), {0x0B, 0xB0, 0x07, 0x20});
+  CHECK(host_usb_in(a, in.data(), in.size()));
+
+  ev = tick(&more);
+  CHECK_EQ(ev.size(), 2);
+  if (ev.size() == 2) {
+    CHECK_EQ(ev[0].port, 1);
+    CHECK_EQ(ev[0].cable, 1);
+    CHECK_EQ(ev[0].msg[2], 0x10);
+    CHECK_EQ(ev[1].port, 0);
+    CHECK_EQ(ev[1].cable, 0);
+    CHECK_EQ(ev[1].msg[2], 0x20);
+  }
+}
+
+// unplugging - the slot is only freed once every transfer has come back, and then it can be used again
+void check_unplug(usb_device_handle_t b) {
+  std::vector<midi_event> ev;
+  bool more;
+  int allocated;
+
+  allocated = host_usb_transfers_allocated;
+  host_usb_unplug(b);
+  CHECK(!usb_midi_devices[1].ready);
+  CHECK(usb_midi_devices[1].in_use);
+
+  ev = tick(&more);                       // flushes the endpoints, which calls back every transfer
+  CHECK(!usb_midi_devices[1].in_use);
+  CHECK_EQ(host_usb_transfers_allocated, allocated - MIDI_IN_BUFFERS - 1);
+  CHECK_EQ(b->claims, 0);
+  CHECK(!b->open);
+
+  host_usb_plug(3);
+  CHECK(usb_midi_devices[1].ready);
+}
+
+// DIN with the event queue full and nothing emptying it - each message that doesn't fit waits DIN_POST_WAIT 
+// for space and is then dropped and counted, rather than the DIN task spinning until loop() runs
+void check_din_full() {
+  std::vector<uint8_t> in;
+  std::vector<midi_event> ev;
+  unsigned long dropped, start;
+  bool more;
+  int i;
+
+  dropped = midi_events_dropped;
+  start = micros();
+  in = {0xB3};
+  for (i = 0; i < MIDI_EVENT_QUEUE_SIZE + 4; i++) in.insert(in.end(), {(uint8_t) i, 0x40});
+  host_uart_receive(in.data(), in.size());
+  din_read(micros());
+  CHECK_EQ(midi_events_dropped - dropped, 4);
+  CHECK_EQ(micros() - start, 4 * DIN_POST_WAIT * 1000UL);
+  CHECK_EQ(midi_events_high_water, MIDI_EVENT_QUEUE_SIZE);
+
+  ev = tick(&more);
+  CHECK_EQ(ev.size(), MIDI_EVENT_QUEUE_SIZE);
+  check_in_order(ev, MIDI_SRC_DIN, 0, MIDI_EVENT_QUEUE_SIZE);
+  printf("DIN into a full queue: %lu dropped after %lu ms waiting\n", midi_events_dropped - dropped, (micros() - start) / 1000);
+}
+
+int main() {
+  usb_device_handle_t a, b;
+
+  setup_midi();
+  ble_midi.reset();
+
+  a = host_usb_plug(1);
+  CHECK(usb_midi_devices[0].ready);
+  bool more;
+  tick(&more);
+  CHECK_EQ(host_feedback_resends, 1);     // a new controller gets the LED states
+
+  check_ten_each(a);
+  check_burst(a);
+
+  b = host_usb_plug(2);
+  tick(&more);
+  check_two_devices(a, b);
+  check_unplug(b);
+  check_din_full();
+
+  return check_result();
+}
@@ -0,0 +1,148 @@
+// An expression pedal sweep through change_generic_param() and flush_param_changes(), as loop() runs them -
+// how many parameter changes go to the amp each second, and whether the amp ends up at the pedal's resting value
+//
+// The pedal sends a CC every 2 ms and rises steadily, then rests - a slow sweep to CC 100 over 700 ms and a
+// fast one over the whole range in 200 ms. The old code, which sent a change whenever the value moved more
+// than 0.04 from the last one sent, is modelled alongside for comparison.
+//
+// Last the app changes the amp to a model that isn't in the catalog, and the pedal moves a parameter of it.
+
+#include "spark_host.h"
+#include "check.h"
+
+#define CC_EVERY_MS 2
+
+struct pedal_sweep {
+  int ms;
+  int top;                                // CC value it rests at
+};
+
+pedal_sweep sweeps[] = {{700, 100}, {200, 127}};
+
+float pedal_value(const pedal_sweep &sw, int ms) {
+  return (int) ((long) sw.top * min(ms, sw.ms) / sw.ms) / 127.0;
+}
+
+// the threshold the code used before coalescing - a change is sent each time the value has moved more than 0.04
+void old_threshold(const pedal_sweep &sw, float start, int *sent, float *error) {
+  float last, val;
+
+  last = start;
+  *sent = 0;
+  for (int ms = 0; ms <= sw.ms; ms += CC_EVERY_MS) {
+    val = pedal_value(sw, ms);
+    if (fabs(last - val) > 0.04) {
+      last = val;
+      (*sent)++;
+    }
+  }
+  *error = fabs(pedal_value(sw, sw.ms) - last);
+}
+
+// one sweep with the given flush interval, a loop() every ms - returns the changes sent
+int sweep(const pedal_sweep &sw, unsigned long interval, float *error, int *writes) {
+  unsigned long messages;
+  float *amp_gain;
+
+  host_spark_setup(0);
+  host_clear_writes();
+  param_flush_interval = interval;
+  amp_gain = &presets[CUR_EDITING][0].effects[3].Parameters[AMP_GAIN];
+  *amp_gain = 0.5;
+  messages = spark_batch.messages;
+
+  for (int ms = 0; ms <= sw.ms + 200; ms++) {
+    if (ms <= sw.ms && ms % CC_EVERY_MS == 0) change_amp_param(AMP_GAIN, pedal_value(sw, ms));
+    flush_param_changes();
+    flush_sparkIO();
+    host_us += 1000;
+  }
+  CHECK_EQ(param_changes_pending, 0);
+  *error = fabs(*amp_gain - pedal_value(sw, sw.ms));
+  *writes = host_spark_writes.size();
+  return spark_batch.messages - messages;
+}
+
+// the message in spark_msg_out as the app would send it - the writes that would go to the amp, put in qFromApp
+void from_app(bool whole) {
+  struct packet_data pd;
+  bool got;
+
+  host_clear_writes();
+  if (whole) 
+    spark_send();
+  else {
+    spark_queue();
+    flush_sparkIO();
+  }
+  for (auto &w : host_spark_writes) {
+    new_packet_from_data(&pd, w.data(), w.size());
+    xQueueSend(qFromApp, &pd, 0);
+  }
+  do 
+    got = update_spark_state();
+  while (got || uxQueueMessagesWaiting(qFromApp) > 0 || uxQueueMessagesWaiting(qFromSpark) > 0);
+  host_clear_writes();
+}
+
+// no parameter is sent for a model the catalog doesn't have until a preset from the app says how many it has
+void check_unknown_model() {
+  SparkPreset::SparkEffects *amp;
+  SparkPreset preset;
+
+  host_spark_setup(0);
+  amp = &presets[CUR_EDITING][0].effects[3];
+  spark_msg_out.change_effect_input(amp->EffectName, (char *) "NewAmp", 0);
+  from_app(false);
+  CHECK(strcmp(amp->EffectName, "NewAmp") == 0);
+  CHECK_EQ(amp->NumParameters, 0);
+
+  host_us += 1000000;
+  change_amp_param(0, 0.9);
+  flush_param_changes();
+  flush_sparkIO();
+  CHECK_EQ(host_spark_writes.size(), 0);
+
+  // the app sends the preset with the new model and its parameters and selects it, which gives the count
+  preset = presets[CUR_EDITING][0];
+  strcpy(preset.effects[3].EffectName, "NewAmp");
+  preset.effects[3].NumParameters = 6;
+  preset.preset_num = 0x7f;
+  spark_msg_out.create_preset(&preset);
+  from_app(true);
+  spark_msg_out.change_hardware_preset(0, 0x7f);
+  from_app(false);
+  CHECK_EQ(amp->NumParameters, 6);
+
+  host_us += 1000000;
+  change_amp_param(0, 0.9);
+  flush_param_changes();
+  flush_sparkIO();
+  CHECK_EQ(host_spark_writes.size(), 1);
+}
+
+int main() {
+  unsigned long intervals[] = {10, PARAM_FLUSH_INTERVAL, 60};
+  int sent, writes, ccs;
+  float error;
+
+  for (const pedal_sweep &sw : sweeps) {
+    ccs = sw.ms / CC_EVERY_MS + 1;
+    old_threshold(sw, 0.5, &sent, &error);
+    printf("%d CCs over %d ms to CC %d\n", ccs, sw.ms, sw.top);
+    printf("  old threshold (model):  %3d changes, %5.1f/s, resting value off by %.3f\n", sent, sent * 1000.0 / sw.ms, error);
+
+    for (unsigned long interval : intervals) {
+      sent = sweep(sw, interval, &error, &writes);
+      printf("  coalesced, every %2lu ms: %3d changes, %5.1f/s in %d writes, resting value off by %.3f\n", 
+             interval, sent, sent * 1000.0 / sw.ms, writes, error);
+      CHECK(error == 0.0);
+      CHECK(sent <= (int) (sw.ms / interval) + 2);
+      CHECK(sent < ccs);
+      CHECK_EQ(writes, sent);
+    }
+  }
+  param_flush_interval = PARAM_FLUSH_INTERVAL;
+  check_unknown_model();
+  return check_result();
+}
@@ -0,0 +1,111 @@
+// Custom preset switches as a diff or a whole preset - bytes on air for every pair of presets in SparkPresets.h,
+// near neighbours where the diff wins, and a change of tempo, which a diff can't carry
+
+#include "spark_host.h"
+#include "check.h"
+
+// whatever the amp sent while it was being switched has been looked at, so start the next switch clean
+void switch_to(SparkPreset *p) {
+  host_clear_writes();
+  change_custom_preset(p, TMP_PRESET);
+  spark_msg_in.message_in.clear();
+}
+
+bool sent(unsigned int cmdsub) {
+  for (auto &w : host_spark_writes)
+    for (size_t i = 0; i + 5 < w.size(); i++)
+      if (w[i] == 0xf0 && w[i + 1] == 0x01 && (w[i + 4] << 8 | w[i + 5]) == cmdsub) return true;
+  return false;
+}
+
+// as preset_diff_report() works it out
+void check_all_pairs() {
+  SparkPreset from, to;
+  int i, j, n, diff_bytes, full_bytes, blocks, wins, diffable;
+  long diff_total, full_total;
+
+  n = sizeof(my_presets) / sizeof(SparkPreset *);
+  wins = 0;
+  diffable = 0;
+  diff_total = 0;
+  full_total = 0;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++) {
+      if (i == j) continue;
+      from = *my_presets[i];
+      to = *my_presets[j];
+      diff_bytes = preset_diff(&from, &to, false, &blocks);
+      full_bytes = preset_upload_bytes(&to, &blocks);
+      full_total += full_bytes;
+      if (diff_bytes < 0) continue;
+      diffable++;
+      diff_total += diff_bytes;
+      if (diff_bytes < full_bytes) wins++;
+    }
+  printf("%d pairs, %d can be diffed, the diff is smaller for %d - mean %ld bytes for a diff, %ld for a whole preset\n",
+         n * (n - 1), diffable, wins, diffable > 0 ? diff_total / diffable : 0L, full_total / (n * (n - 1)));
+  CHECK_EQ(n * (n - 1), 552);
+  CHECK_EQ(diffable, 552);                // every preset there is at 120 BPM
+  CHECK_EQ(wins, 0);
+}
+
+void check_neighbours() {
+  SparkPreset p;
+  int bytes, blocks, full_bytes, full_blocks;
+
+  host_spark_setup(0);
+  p = *my_presets[0];
+  p.effects[2].OnOff = !p.effects[2].OnOff;
+  p.effects[3].Parameters[AMP_GAIN] = 0.9;
+  strcpy(p.Name, "Neighbour");
+  bytes = preset_diff(&presets[CUR_EDITING][0], &p, false, &blocks);
+  full_bytes = preset_upload_bytes(&p, &full_blocks);
+  printf("one toggle and one parameter: %d bytes in %d block, whole preset %d in %d blocks\n", bytes, blocks,
+         full_bytes, full_blocks);
+  CHECK_EQ(blocks, 1);
+  switch_to(&p);
+  CHECK(custom_switch_diff);
+  CHECK(custom_switch_acked);
+  CHECK_EQ(custom_switch_bytes, bytes);
+  CHECK_EQ(host_bytes(host_spark_writes), bytes);
+  CHECK(!sent(0x0101));
+  CHECK(presets[CUR_EDITING][0].effects[3].Parameters[AMP_GAIN] == (float) 0.9);
+  CHECK(presets[CUR_EDITING][0].effects[2].OnOff == p.effects[2].OnOff);
+  CHECK(strcmp(presets[CUR_EDITING][0].Name, my_presets[0]->Name) == 0);   // a diff doesn't name the preset
+
+  host_spark_setup(0);
+  p = *my_presets[0];
+  strcpy(p.effects[3].EffectName, "Twin");
+  bytes = preset_diff(&presets[CUR_EDITING][0], &p, false, &blocks);
+  printf("one model change: %d bytes in %d blocks\n", bytes, blocks);
+  switch_to(&p);
+  CHECK(custom_switch_diff);
+  CHECK(sent(0x0106));
+  CHECK(strcmp(presets[CUR_EDITING][0].effects[3].EffectName, "Twin") == 0);
+}
+
+// the amp's tempo is only set by a whole preset, so a switch to a different tempo never goes as a diff
+void check_tempo() {
+  SparkPreset p;
+  int blocks;
+
+  host_spark_setup(0);
+  p = *my_presets[0];
+  p.BPM = 90.0;
+  CHECK_EQ(preset_diff(&presets[CUR_EDITING][0], &p, false, &blocks), -1);
+  switch_to(&p);
+  CHECK(!custom_switch_diff);
+  CHECK(custom_switch_acked);
+  CHECK(sent(0x0101));
+  CHECK(sent(0x0138));
+  CHECK(presets[CUR_EDITING][0].BPM == (float) 90.0);
+  CHECK(presets[TMP_PRESET][0].BPM == (float) 90.0);
+  printf("tempo change: whole preset, %d bytes\n", custom_switch_bytes);
+}
+
+int main() {
+  check_all_pairs();
+  check_neighbours();
+  check_tempo();
+  return check_result();
+}
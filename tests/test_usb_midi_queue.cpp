@@ -0,0 +1,112 @@
+// UsbMidiQueue with midi_transfer_cb()'s side and update_midi()'s side on two threads
+//
+// Each packet carries its sequence number in every field, so a packet read while half written, or read
+// twice, or out of order, shows up. Build with -DSANITIZE_THREAD=ON to run it under ThreadSanitizer too.
+
+#include "Arduino.h"
+#include "check.h"
+#include "UsbMidiQueue.h"
+
+#include <atomic>
+#include <thread>
+
+#define PACKETS 200000
+
+UsbMidiQueue q;
+std::atomic<bool> producer_done;
+
+// the packet for sequence number n - the CIN nibble is n & 0x0f, the rest n in 7 bit pieces
+void make_packet(uint32_t n, uint8_t *p) {
+  p[0] = n & 0x0f;
+  p[1] = (n >> 4) & 0x7f;
+  p[2] = (n >> 11) & 0x7f;
+  p[3] = (n >> 18) & 0x7f;
+}
+
+bool packet_ok(const usb_midi_packet &pk) {
+  uint8_t want[4];
+
+  make_packet(pk.arrival, want);
+  return memcmp(pk.p, want, 4) == 0 && pk.port == (pk.arrival & 3);
+}
+
+struct result {
+  unsigned long popped;
+  unsigned long torn;
+  unsigned long out_of_order;
+};
+
+// retry - the producer waits for space, so every packet must come out once, in order
+// otherwise it drops on full as midi_transfer_cb() does, and what comes out must be in order and whole
+result run(bool retry, unsigned long *sent) {
+  result r {0, 0, 0};
+  uint8_t p[4];
+  long last;
+  // a transfer's worth at a time, or when dropping more than the queue holds so some must be dropped
+  uint32_t burst = retry ? 16 : USB_MIDI_QUEUE_SIZE + 16;
+
+  q = UsbMidiQueue();
+  producer_done = false;
+  *sent = 0;
+
+  std::thread producer([&] {
+    for (uint32_t n = 0; n < PACKETS; n++) {
+      make_packet(n, p);
+      while (!q.push(p, n & 3, n) && retry) std::this_thread::yield();
+      (*sent)++;
+      if (n % burst == burst - 1) std::this_thread::yield();
+    }
+    producer_done.store(true, std::memory_order_release);
+  });
+
+  std::thread consumer([&] {
+    usb_midi_packet pk;
+
+    last = -1;
+    bool done;
+
+    while (true) {
+      // done is read first, so an empty queue after it means everything has been taken
+      done = producer_done.load(std::memory_order_acquire);
+      if (!q.pop(&pk)) {
+        if (done) break;
+        std::this_thread::yield();
+        continue;
+      }
+      r.popped++;
+      if (!packet_ok(pk)) r.torn++;
+      if ((long) pk.arrival <= last) r.out_of_order++;
+      if (retry && (long) pk.arrival != last + 1) r.out_of_order++;
+      last = pk.arrival;
+    }
+  });
+
+  producer.join();
+  consumer.join();
+  return r;
+}
+
+int main() {
+  result r;
+  unsigned long sent;
+
+  r = run(true, &sent);
+  printf("producer retrying on full: %lu sent, %lu popped, %lu torn, %lu out of order, high water %u/%d\n",
+         sent, r.popped, r.torn, r.out_of_order, q.high_water, USB_MIDI_QUEUE_SIZE);
+  CHECK_EQ(r.popped, PACKETS);
+  CHECK_EQ(q.pushed, PACKETS);
+  CHECK_EQ(r.torn, 0);
+  CHECK_EQ(r.out_of_order, 0);
+
+  r = run(false, &sent);
+  printf("producer dropping on full: %lu sent, %lu accepted, %lu overflows, %lu popped, %lu torn, %lu out of order\n",
+         sent, q.pushed, q.overflows, r.popped, r.torn, r.out_of_order);
+  CHECK_EQ(q.pushed + q.overflows, PACKETS);
+  CHECK(q.overflows > 0);
+  CHECK_EQ(r.popped, q.pushed);
+  CHECK_EQ(r.torn, 0);
+  CHECK_EQ(r.out_of_order, 0);
+  CHECK(q.high_water <= USB_MIDI_QUEUE_SIZE);
+
+  return check_result();
+}
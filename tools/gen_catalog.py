@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""Build the model catalog for SparkMIDICaptain3 from the protocol description and SparkPresets.h.
+
+Usage:
+    gen_catalog.py [SparkPresets.h] [-m spark_models.txt] [-o ModelCatalog.h] [--check]
+
+spark_models.txt is Appendix 2 of "Spark Protocol Description v3.5.pdf": every
+model's Spark name and the slot it goes in (0 noisegate to 6 reverb). That is
+all the protocol description says about models - it has no parameter counts
+and no values - so those come from the presets. Every effect in every preset
+names its model, how many parameters it has and their values. The catalog has
+one entry for each model that is in both: its slot, its parameter count and,
+as defaults, the values it has in the first preset that uses it with that
+many parameters. The defaults are only used for a parameter the model before
+it in the slot didn't have.
+
+A model in a different slot from the protocol description, or in two slots,
+is an error and nothing is written. A model found with different parameter
+counts (bias.noisegate has 2 in older presets and 3 in newer ones) is a note,
+and the largest count is used. A model no preset uses is left out, as there
+is no telling how many parameters to send it, and a model the protocol
+description doesn't list is kept in the slot its presets put it in.
+
+The entries are in slot order, and in the protocol description's order
+within a slot, and model_slot_start[] gives the first entry for each slot, so
+the amp_next and mod_next actions step through one slot's models in the same
+order every build.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+SKETCH = os.path.join(os.path.dirname(__file__), "..", "SparkMIDICaptain3")
+DEFAULT_INPUT = os.path.join(SKETCH, "SparkPresets.h")
+DEFAULT_OUTPUT = os.path.join(SKETCH, "ModelCatalog.h")
+DEFAULT_MODELS = os.path.join(os.path.dirname(__file__), "spark_models.txt")
+
+SLOTS = ["noisegate", "comp", "drive", "amp", "mod", "delay", "reverb"]
+MAX_PARAMS = 10                         # SparkPreset has Parameters[10]
+
+PRESET_RE = re.compile(r"const\s+SparkPreset\s+(\w+)\s*\{(.*?)\}\s*,\s*0x[0-9a-fA-F]+\s*\}\s*;", re.S)
+EFFECT_RE = re.compile(r'\{\s*"([^"]+)"\s*,\s*(?:true|false)\s*,\s*(\d+)\s*,\s*\{([^}]*)\}\s*\}')
+
+
+def parse_models(path):
+    """Return [(name, slot)] in the protocol description's order and the number of errors."""
+    models = []
+    errors = 0
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            fields = [field.strip() for field in line.split("|")]
+            if len(fields) != 3 or fields[0] not in SLOTS:
+                print("%s:%d: error: expected slot | Spark name | app name" % (path, n), file=sys.stderr)
+                errors += 1
+                continue
+            models.append((fields[1], SLOTS.index(fields[0])))
+    return models, errors
+
+
+def check_slots(models, known, path):
+    """Check the presets' models against the protocol description, return the number of errors."""
+    errors = 0
+    slots = dict(known)
+    for name, (slot, _, _) in sorted(models.items()):
+        if name not in slots:
+            print("%s: note: %s is not in the protocol description, kept in the %s slot" % (path, name, SLOTS[slot]),
+                  file=sys.stderr)
+        elif slots[name] != slot:
+            print("%s: error: %s is in the %s slot, the protocol description has it in the %s slot" %
+                  (path, name, SLOTS[slot], SLOTS[slots[name]]), file=sys.stderr)
+            errors += 1
+    unused = [name for name, _ in known if name not in models]
+    if unused:
+        print("%s: note: %d models no preset uses are left out: %s" % (path, len(unused), " ".join(unused)),
+              file=sys.stderr)
+    return errors
+
+
+def parse(path):
+    """Return {name: (slot, num_params, defaults)} and the number of errors."""
+    with open(path) as f:
+        text = f.read()
+
+    models = {}
+    noted = set()
+    errors = 0
+    for preset, body in PRESET_RE.findall(text):
+        effects = EFFECT_RE.findall(body)
+        if len(effects) != len(SLOTS):
+            print("%s: %s: error: %d effects, expected %d" % (path, preset, len(effects), len(SLOTS)), file=sys.stderr)
+            errors += 1
+            continue
+        for slot, (name, count, values) in enumerate(effects):
+            count = int(count)
+            params = [float(v) for v in values.split(",") if v.strip()]
+            if count != len(params) or count > MAX_PARAMS:
+                print("%s: %s: error: %s has %d parameters listed as %d" % (path, preset, name, len(params), count),
+                      file=sys.stderr)
+                errors += 1
+                continue
+            old = models.get(name)
+            if old is None:
+                models[name] = (slot, count, params)
+            elif old[0] != slot:
+                print("%s: %s: error: %s is in the %s slot here and the %s slot before" %
+                      (path, preset, name, SLOTS[slot], SLOTS[old[0]]), file=sys.stderr)
+                errors += 1
+            elif old[1] != count and name not in noted:
+                noted.add(name)
+                print("%s: %s: note: %s has %d parameters here and %d before" % (path, preset, name, count, old[1]),
+                      file=sys.stderr)
+            if old is not None and old[0] == slot and count > old[1]:
+                models[name] = (slot, count, params)
+    return models, errors
+
+
+def header(source, models, known):
+    order = {name: i for i, (name, _) in enumerate(known)}
+    entries = sorted(models.items(), key=lambda m: (m[1][0], order.get(m[0], len(order)), m[0].lower()))
+    starts = [0] * (len(SLOTS) + 1)
+    for name, (slot, _, _) in entries:
+        starts[slot + 1] += 1
+    for s in range(len(SLOTS)):
+        starts[s + 1] += starts[s]
+    width = max(len(name) for name in models) + 3
+
+    out = []
+    out.append("#ifndef ModelCatalog_h")
+    out.append("#define ModelCatalog_h")
+    out.append("")
+    out.append("// Generated by tools/gen_catalog.py from %s - edit those and run it again, not this" % source)
+    out.append("")
+    out.append("#define MODEL_COUNT %d" % len(entries))
+    out.append("")
+    out.append("const spark_model model_catalog[MODEL_COUNT] {")
+    for name, (slot, count, params) in entries:
+        out.append("  {%-*s %d, %d, {%s}}," % (width, '"%s",' % name, slot, count,
+                                              ", ".join("%.6f" % p for p in params)))
+    out.append("};")
+    out.append("")
+    out.append("// first entry for each slot - slot n is model_slot_start[n] up to model_slot_start[n + 1]")
+    out.append("const int model_slot_start[8] {%s};" % ", ".join(str(s) for s in starts))
+    out.append("")
+    out.append("#endif")
+    return "\r\n".join(out) + "\r\n"        # the sketch files are all CRLF
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("presets", nargs="?", default=DEFAULT_INPUT)
+    parser.add_argument("-m", "--models", default=DEFAULT_MODELS)
+    parser.add_argument("-o", "--output", default=DEFAULT_OUTPUT)
+    parser.add_argument("--check", action="store_true", help="only check the presets, write nothing")
+    args = parser.parse_args()
+
+    known, errors = parse_models(args.models)
+    models, preset_errors = parse(args.presets)
+    errors += preset_errors
+    if not errors:
+        errors += check_slots(models, known, args.presets)
+    if errors:
+        sys.exit("%d error%s" % (errors, "" if errors == 1 else "s"))
+    if not models:
+        sys.exit("%s: no presets found" % args.presets)
+    if args.check:
+        return
+
+    text = header("%s and %s" % (os.path.basename(args.models), os.path.basename(args.presets)), models, known)
+    with open(args.output, "w", newline="") as f:
+        f.write(text)
+    print("%s: %d models" % (args.output, len(models)))
+
+
+if __name__ == "__main__":
+    main()
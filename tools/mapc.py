@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""Compile a MIDI mapping file into the built in mapping table for SparkMIDICaptain3.
+
+Usage:
+    mapc.py map_builtin.txt [-o MidiMapBuiltin.h] [--map-h path/to/MidiMap.h]
+    mapc.py --check data/map1.txt ...
+
+The mapping file is the same format as the LittleFS profiles (see MidiMap.h):
+
+    <type> <channel> <data1> <action> [<curve>[:<lo>-<hi>]]
+
+The type, action and curve names are read from MidiMap.h, so the tool always
+agrees with the firmware. Every line is checked - an unknown type, action or
+curve, a channel outside 1-16, a data byte outside 0-127, a curve range outside
+0-1 or a curve on anything but a cc is an error and nothing is written. A line that changes a mapping made by an earlier line, or the curve of
+a cc (a cc line with no curve is lin 0-1, as in the firmware), is a warning, or an error with --strict.
+
+The output is a header of constexpr tables: the distinct 128 entry rows, and
+for each type and channel which row it uses. Most channels share a row, so this
+is much smaller than the full table, and midi_map_default() only has to copy
+rows at start up. The curves are listed in the order they were read, so each
+gets the index it would have if the file were loaded as a profile, and then the
+curve each cc ends up with. The firmware works out their 128 entry tables at
+start up.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+SKETCH = os.path.join(os.path.dirname(__file__), "..", "SparkMIDICaptain3")
+DEFAULT_MAP_H = os.path.join(SKETCH, "MidiMap.h")
+DEFAULT_INPUT = os.path.join(os.path.dirname(__file__), "map_builtin.txt")
+DEFAULT_OUTPUT = os.path.join(SKETCH, "MidiMapBuiltin.h")
+
+
+def read_names(map_h):
+    with open(map_h) as f:
+        text = f.read()
+
+    def strings(array):
+        body = re.search(r"%s\[\]\s*\{(.*?)\};" % array, text, re.S).group(1)
+        return re.findall(r'"(\w+)"', body)
+
+    def enum(name):
+        body = re.search(r"enum\s+%s\s*\{(.*?)\};" % name, text, re.S).group(1)
+        return re.findall(r"\b(\w+)\b", body)
+
+    types = strings("midi_map_type_names")
+    actions = strings("midi_action_names")
+    action_enum = [a for a in enum("midi_action_t") if a != "ACT_COUNT"]
+    if len(actions) != len(action_enum):
+        sys.exit("%s: midi_action_names[] and midi_action_t don't match" % map_h)
+    curves = strings("midi_curve_names")
+    curve_enum = [c for c in enum("midi_curve_shape_t") if c != "CURVE_SHAPES"]
+    if len(curves) != len(curve_enum):
+        sys.exit("%s: midi_curve_names[] and midi_curve_shape_t don't match" % map_h)
+    max_curves = int(re.search(r"#define\s+MIDI_MAP_CURVES\s+(\d+)", text).group(1))
+    return types, actions, action_enum, curves, curve_enum, max_curves
+
+
+def parse_curve(text, curves):
+    """'log:0.2-0.8' to (shape, lo, hi), or a message saying what is wrong."""
+    name, _, rng = text.partition(":")
+    if name not in curves:
+        return "unknown curve '%s' (one of %s)" % (name, " ".join(curves))
+    lo, hi = 0.0, 1.0
+    if rng:
+        m = re.fullmatch(r"([0-9.]+)-([0-9.]+)", rng)
+        if not m:
+            return "curve range '%s' should be <lo>-<hi>" % rng
+        try:
+            lo, hi = float(m.group(1)), float(m.group(2))
+        except ValueError:
+            return "curve range '%s' should be <lo>-<hi>" % rng
+        if not (0.0 <= lo <= 1.0 and 0.0 <= hi <= 1.0):
+            return "curve range '%s' is not within 0-1" % rng
+    return (curves.index(name), lo, hi)
+
+
+def curve_name(curve, curves):
+    if curve is None:
+        return "lin"
+    shape, lo, hi = curve
+    return "%s:%g-%g" % (curves[shape], lo, hi)
+
+
+def parse(path, types, actions, curves, max_curves, strict):
+    """Return {(type, chan, data1): action}, the curves other than lin 0-1 in the order they were read,
+    {(chan, data1): curve} for the ccs that aren't lin 0-1 and the number of errors."""
+    table = {}
+    cc_curves = {}
+    specs = []
+    errors = 0
+
+    def problem(line_num, msg, error=True):
+        nonlocal errors
+        print("%s:%d: %s: %s" % (path, line_num, "error" if error else "warning", msg), file=sys.stderr)
+        errors += error
+
+    with open(path) as f:
+        for line_num, line in enumerate(f, 1):
+            fields = line.split("#")[0].split()
+            if not fields:
+                continue
+            if len(fields) not in (4, 5):
+                problem(line_num, "expected <type> <channel> <data1> <action> [<curve>]")
+                continue
+            type_s, chan_s, data_s, act_s = fields[:4]
+
+            if type_s not in types:
+                problem(line_num, "unknown type '%s' (one of %s)" % (type_s, " ".join(types)))
+                continue
+            if act_s not in actions:
+                problem(line_num, "unknown action '%s' (one of %s)" % (act_s, " ".join(actions)))
+                continue
+            try:
+                chans = range(16) if chan_s == "*" else [int(chan_s) - 1]
+                datas = range(128) if data_s == "*" else [int(data_s)]
+            except ValueError:
+                problem(line_num, "channel and data1 must be numbers or *")
+                continue
+            if not 0 <= chans[0] <= 15:
+                problem(line_num, "channel %s is not 1-16" % chan_s)
+                continue
+            if not 0 <= datas[0] <= 127:
+                problem(line_num, "data1 %s is not 0-127" % data_s)
+                continue
+
+            curve = None
+            if len(fields) == 5:
+                curve = parse_curve(fields[4], curves)
+                if isinstance(curve, str):
+                    problem(line_num, curve)
+                    continue
+                if type_s != "cc":
+                    problem(line_num, "only a cc can have a curve")
+                    continue
+                if curve[0] == 0 and curve[1:] == (0.0, 1.0):
+                    curve = None
+            # the firmware keeps a curve once it has read it, even if a later line takes it off every cc
+            if curve is not None and curve not in specs:
+                if len(specs) == max_curves - 1:
+                    problem(line_num, "more than %d different curves" % (max_curves - 1))
+                    continue
+                specs.append(curve)
+
+            t = types.index(type_s)
+            a = actions.index(act_s)
+            for c in chans:
+                for d in datas:
+                    old = table.get((t, c, d))
+                    if old is not None and old != a:
+                        problem(line_num, "%s channel %d %d was %s, now %s" %
+                                (type_s, c + 1, d, actions[old], act_s), error=strict)
+                    table[(t, c, d)] = a
+                    if type_s != "cc":
+                        continue
+                    # a cc line with no curve puts the cc back to lin 0-1, as midi_map_set() does
+                    old = cc_curves.pop((c, d), None)
+                    if old is not None and old != curve:
+                        problem(line_num, "cc channel %d %d had curve %s, now %s" %
+                                (c + 1, d, curve_name(old, curves), curve_name(curve, curves)), error=strict)
+                    if curve is not None:
+                        cc_curves[(c, d)] = curve
+    return table, specs, cc_curves, errors
+
+
+def header(source, table, specs, cc_curves, types, action_enum, curve_enum):
+    rows = []
+    index = []
+    for t in range(len(types)):
+        index.append([])
+        for c in range(16):
+            row = tuple(table.get((t, c, d), 0) for d in range(128))
+            if row not in rows:
+                rows.append(row)
+            index[t].append(rows.index(row))
+
+    out = []
+    out.append("#ifndef MidiMapBuiltin_h")
+    out.append("#define MidiMapBuiltin_h")
+    out.append("")
+    out.append("// Generated by tools/mapc.py from %s - edit that and run it again, not this" % source)
+    out.append("")
+    out.append("#define MIDI_MAP_BUILTIN_ROWS %d" % len(rows))
+    out.append("")
+    out.append("static_assert(ACT_COUNT == %d, \"midi_action_t has changed - run tools/mapc.py again\");" % len(action_enum))
+    out.append("")
+    out.append("constexpr uint8_t midi_map_builtin_rows[MIDI_MAP_BUILTIN_ROWS][128] {")
+    for row in rows:
+        out.append("  {")
+        for i in range(0, 128, 8):
+            out.append("    " + " ".join("%s," % action_enum[a] for a in row[i:i + 8]))
+        out.append("  },")
+    out.append("};")
+    out.append("")
+    uses = []
+    for d in range(128):
+        chan_curves = [cc_curves.get((c, d)) for c in range(16)]
+        if chan_curves[0] is not None and chan_curves.count(chan_curves[0]) == 16:
+            uses.append((-1, d, chan_curves[0]))
+        else:
+            uses += [(c, d, curve) for c, curve in enumerate(chan_curves) if curve is not None]
+    out.append("// curves other than lin 0-1 in the order they were read, so each is at the index it has when the")
+    out.append("// same file is loaded as a profile")
+    out.append("#define MIDI_MAP_BUILTIN_SPECS %d" % len(specs))
+    out.append("")
+    out.append("constexpr midi_curve_spec midi_map_builtin_specs[MIDI_MAP_BUILTIN_SPECS + 1] {")
+    for shape, lo, hi in specs:
+        out.append("  {%s, %rf, %rf}," % (curve_enum[shape], lo, hi))
+    out.append("  {CURVE_LIN, 0.0f, 1.0f}     // unused - so the array is never empty")
+    out.append("};")
+    out.append("")
+    out.append("// curve of each cc that isn't lin 0-1, as the last line for it left it")
+    out.append("#define MIDI_MAP_BUILTIN_CURVES %d" % len(uses))
+    out.append("")
+    out.append("constexpr midi_curve_use midi_map_builtin_curves[MIDI_MAP_BUILTIN_CURVES + 1] {")
+    for chan, d, curve in uses:
+        out.append("  {%d, %d, %d}," % (chan, d, specs.index(curve) + 1))
+    out.append("  {0, 0, 0}     // unused - so the array is never empty")
+    out.append("};")
+    out.append("")
+    out.append("// row for each type and channel")
+    out.append("constexpr uint8_t midi_map_builtin_index[MAP_TYPES][16] {")
+    for t, name in enumerate(types):
+        out.append("  {%s},    // %s" % (", ".join(str(r) for r in index[t]), name))
+    out.append("};")
+    out.append("")
+    out.append("#endif")
+    return "\r\n".join(out) + "\r\n"        # the sketch files are all CRLF
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("mapping", nargs="*")
+    parser.add_argument("-o", "--output", default=DEFAULT_OUTPUT)
+    parser.add_argument("--map-h", default=DEFAULT_MAP_H)
+    parser.add_argument("--check", action="store_true", help="only check the files, write nothing")
+    parser.add_argument("--strict", action="store_true", help="treat overridden mappings as errors")
+    args = parser.parse_args()
+
+    types, actions, action_enum, curves, curve_enum, max_curves = read_names(args.map_h)
+    files = args.mapping or [DEFAULT_INPUT]
+    if not args.check and len(files) != 1:
+        sys.exit("only one mapping file can be compiled into the built in table")
+
+    errors = 0
+    for path in files:
+        table, specs, cc_curves, e = parse(path, types, actions, curves, max_curves, args.strict)
+        errors += e
+    if errors:
+        sys.exit("%d error%s" % (errors, "" if errors == 1 else "s"))
+    if args.check:
+        return
+
+    text = header(os.path.basename(files[0]), table, specs, cc_curves, types, action_enum, curve_enum)
+    with open(args.output, "w", newline="") as f:
+        f.write(text)
+    print("%s: %d mappings" % (args.output, len(table)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Turn a 'trace' dump from the SparkMIDICaptain3 serial console into a timeline.
+
+Usage:
+    trace_timeline.py capture.txt [--trace-h path/to/Trace.h]
+
+capture.txt is a serial monitor log holding one or more blocks of
+
+    TRACE BEGIN <entries> <cpu MHz>
+    cccccccc aaaa ss oo
+    TRACE END
+
+Entries are in the order they were recorded. The cycle counters of the two
+cores run together but are not synchronised exactly, so a small negative delta
+between entries from different cores is skew rather than time going backwards.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+DEFAULT_TRACE_H = os.path.join(os.path.dirname(__file__), "..", "SparkMIDICaptain3", "Trace.h")
+
+
+def read_stage_names(trace_h):
+    with open(trace_h) as f:
+        text = f.read()
+    body = re.search(r"enum\s+trace_stage_t\s*\{(.*?)\};", text, re.S).group(1)
+    return re.findall(r"^\s*(TR_\w+)", body, re.M)
+
+
+def read_blocks(lines):
+    block = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("TRACE BEGIN"):
+            mhz = int(line.split()[3])
+            block = []
+        elif line.startswith("TRACE END") and block is not None:
+            yield mhz, block
+            block = None
+        elif block is not None:
+            fields = line.split()
+            if len(fields) == 4:
+                block.append(tuple(int(f, 16) for f in fields))
+
+
+def timeline(mhz, entries, names):
+    last_cycles = None
+    elapsed = 0
+    prev_us = None
+    for cycles, arg, stage, core in entries:
+        if last_cycles is not None:
+            # signed difference copes with the 32 bit counter wrapping and with skew between cores
+            elapsed += ((cycles - last_cycles + 0x80000000) & 0xffffffff) - 0x80000000
+        last_cycles = cycles
+        us = elapsed / mhz
+        delta = "" if prev_us is None else "%+10.1f" % (us - prev_us)
+        prev_us = us
+        name = names[stage] if stage < len(names) else "stage %d" % stage
+        print("%12.1f %10s  core %d  %-22s 0x%04x" % (us, delta, core, name, arg))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture")
+    parser.add_argument("--trace-h", default=DEFAULT_TRACE_H)
+    args = parser.parse_args()
+
+    names = read_stage_names(args.trace_h)
+    with open(args.capture, errors="replace") as f:
+        blocks = list(read_blocks(f))
+    if not blocks:
+        sys.exit("no TRACE BEGIN / TRACE END block found")
+
+    for n, (mhz, entries) in enumerate(blocks):
+        print("Trace %d: %d entries at %d MHz" % (n, len(entries), mhz))
+        print("%12s %10s  %-6s  %-22s %s" % ("time us", "delta us", "core", "stage", "arg"))
+        timeline(mhz, entries, names)
+        print()
+
+
+if __name__ == "__main__":
+    main()